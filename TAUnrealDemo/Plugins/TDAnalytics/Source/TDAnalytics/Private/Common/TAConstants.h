@@ -37,6 +37,7 @@ public:
 	//constexpr static char const* const KEY_SAVE_CONFIG_SUFFIX = ".TAConfig";
 	const static uint32 USER_INDEX_EVENT = 76;
 	constexpr static char const* const KEY_SAVE_EVENT_SUFFIX = ".TAEvent";
+	constexpr static char const* const EVENT_STORE_DIR = "TDAnalytics";
 
 	//EVENT TYPE
    	constexpr static char const* const EVENTTYPE_TRACK = "track";
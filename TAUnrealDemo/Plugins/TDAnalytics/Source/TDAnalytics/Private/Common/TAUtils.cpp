@@ -1,33 +1,57 @@
 // Copyright 2021 ThinkingData. All Rights Reserved.
 #include "TAUtils.h"
 
+THIRD_PARTY_INCLUDES_START
+#include "zlib.h"
+THIRD_PARTY_INCLUDES_END
+
 FString FTAUtils::Pattern = TEXT("^[a-zA-Z][a-zA-Z\\d_]{0,49}$");
 
 TArray<FString>* FTAUtils::DEFAULT_KEYS = new TArray<FString>{TEXT("#bundle_id"),TEXT("#duration")};
 
 
-FString FTAUtils::EncodeData(const FString& UnprocessedStr)
+bool FTAUtils::CompressData(const uint8* UnprocessedData, int32 UnprocessedDataLen, TArray<uint8>& OutCompressedData, int32 Level)
 {
-	// Compatible with Chinese
-	FTCHARToUTF8 ToUtf8Converter(UnprocessedStr.GetCharArray().GetData());
-	auto UnprocessedDataLen = ToUtf8Converter.Length();
-	auto UnprocessedData = ToUtf8Converter.Get();
-	int32 CompressBufferLen = FCompression::CompressMemoryBound(NAME_Gzip, UnprocessedDataLen);
-	void* CompressBuffer = FMemory::Malloc(CompressBufferLen);
-	bool Result = FCompression::CompressMemory(NAME_Gzip, CompressBuffer, CompressBufferLen, UnprocessedData, 
-		UnprocessedDataLen, ECompressionFlags::COMPRESS_BiasSpeed);
-
-	FString CompressedStr; 
+	// a one-off large body is not kept around
+	const int32 MAX_KEPT_BUFFER = 1024 * 1024;
+	static thread_local TArray<uint8> CompressBuffer;
+
+	// windowBits 31 writes the gzip header and trailer
+	z_stream Stream;
+	FMemory::Memzero(Stream);
+	bool Result = deflateInit2(&Stream, FMath::Clamp(Level, 1, 9), Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+	int32 CompressBufferLen = 0;
+	if ( Result )
+	{
+		int32 Bound = (int32)deflateBound(&Stream, UnprocessedDataLen);
+		if ( CompressBuffer.Num() < Bound )
+		{
+			CompressBuffer.SetNumUninitialized(Bound);
+		}
+		Stream.next_in = (Bytef*)UnprocessedData;
+		Stream.avail_in = UnprocessedDataLen;
+		Stream.next_out = CompressBuffer.GetData();
+		Stream.avail_out = Bound;
+		Result = deflate(&Stream, Z_FINISH) == Z_STREAM_END;
+		CompressBufferLen = (int32)Stream.total_out;
+		deflateEnd(&Stream);
+	}
+
 	if ( Result )
 	{
-		CompressedStr = FBase64::Encode((uint8*)CompressBuffer, CompressBufferLen);
+		OutCompressedData.Reset(CompressBufferLen);
+		OutCompressedData.Append(CompressBuffer.GetData(), CompressBufferLen);
 	}
 	else
 	{
-		FTALog::Warning(CUR_LOG_POSITION, TEXT("EncodeData Error !"));
+		OutCompressedData.Empty();
+		FTALog::Warning(CUR_LOG_POSITION, TEXT("CompressData Error !"));
 	}
-	FMemory::Free(CompressBuffer);
-	return CompressedStr;
+	if ( CompressBuffer.Num() > MAX_KEPT_BUFFER )
+	{
+		CompressBuffer.Empty();
+	}
+	return Result;
 }
 
 FString FTAUtils::GetCurrentTimeStamp()
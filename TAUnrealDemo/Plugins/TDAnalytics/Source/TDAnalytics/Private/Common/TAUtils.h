@@ -76,7 +76,14 @@ public:
 
 	static void FormatCustomTimeWithOffset(FString& DateTimeStr, float Zone_Offset);
 
-	static FString EncodeData(const FString& UnprocessedData);
+	const static int32 GZIP_LEVEL_FASTEST = 1;
+
+	const static int32 GZIP_LEVEL_DEFAULT = 6;
+
+	const static int32 GZIP_LEVEL_SMALLEST = 9;
+
+	// gzip of a UTF-8 body at deflate Level (1-9) into a per thread scratch buffer, OutCompressedData gets the exact compressed size
+	static bool CompressData(const uint8* UnprocessedData, int32 UnprocessedDataLen, TArray<uint8>& OutCompressedData, int32 Level = GZIP_LEVEL_FASTEST);
 
 	static FString GetAverageFps();
 
@@ -2,16 +2,10 @@
 
 #include "EventManager.h"
 #include "TaskHandle.h"
+#include "TAScheduler.h"
 #include "TASaveEvent.h"
 #include "TDAnalyticsPC.h"
 
-#if WITH_EDITOR
-#include "Editor/EditorEngine.h"
-#include "Editor/UnrealEdEngine.h"
-#else
-#include "Engine/GameEngine.h"
-#endif
-
 UTAEventManager::UTAEventManager()
 {
 
@@ -46,8 +40,6 @@ void UTAEventManager::EnqueueUserEvent(const FString& EventType, const FString&
 	TSharedRef<TJsonWriter<>> DataWriter = TJsonWriterFactory<>::Create(&DataStr);
 	FJsonSerializer::Serialize(m_DataJsonObject.ToSharedRef(), DataWriter);
 	m_TaskHandle->AddTask(DataStr);
-	// FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("IsTimerActive1 = %s"), *(UKismetStringLibrary::Conv_BoolToString(m_GameInstance->GetTimerManager().IsTimerActive(WorkHandle)))));
-	// FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("IsTimerPaused1 = %s"), *(UKismetStringLibrary::Conv_BoolToString(m_GameInstance->GetTimerManager().IsTimerPaused(WorkHandle)))));
 }
 
 void UTAEventManager::EnqueueTrackEvent(const FString& EventName, const FString& Properties, const FString& DynamicProperties, const FString& EventType, const FString& AddProperties)
@@ -132,21 +124,14 @@ void UTAEventManager::EnqueueTrackEvent(const FString& EventName, const FString&
 	TSharedRef<TJsonWriter<>> DataWriter = TJsonWriterFactory<>::Create(&DataStr);
 	FJsonSerializer::Serialize(m_DataJsonObject.ToSharedRef(), DataWriter);
 	m_TaskHandle->AddTask(DataStr);
-	// FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("IsTimerActive2 = %s"), *(UKismetStringLibrary::Conv_BoolToString(m_GameInstance->GetTimerManager().IsTimerActive(WorkHandle)))));
-	// FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("IsTimerPaused2 = %s"), *(UKismetStringLibrary::Conv_BoolToString(m_GameInstance->GetTimerManager().IsTimerPaused(WorkHandle)))));
 }
 
 void UTAEventManager::BindInstance(UTDAnalyticsPC *Instance)
 {
 	m_Instance = Instance;
-	//start timer
-	//event num & time
-	m_GameInstance = GetGameInstance();
-	m_GameInstance->AddToRoot();
-	m_GameInstance->GetTimerManager().SetTimer(WorkHandle, this, &UTAEventManager::Flush, 15.0f, true);
-
+	// the periodic flush runs on the scheduler tick, no game instance needed
 	m_TaskHandle = new FTaskHandle(Instance);
-	m_RunnableThread = FRunnableThread::Create(m_TaskHandle, TEXT("TaskHandle"), 128 * 1024, TPri_AboveNormal, FPlatformAffinity::GetPoolThreadMask());
+	FTAScheduler::Get().Register(m_TaskHandle);
 }
 
 void UTAEventManager::Flush()
@@ -157,17 +142,3 @@ void UTAEventManager::Flush()
 		m_TaskHandle->AddTask(TEXT(""));
 	}
 }
-
-UGameInstance* UTAEventManager::GetGameInstance()
-{
-	UGameInstance* GameInstance = nullptr;
-#if WITH_EDITOR
-	UUnrealEdEngine* engine = Cast<UUnrealEdEngine>(GEngine);
-	if (engine && engine->PlayWorld) GameInstance = engine->PlayWorld->GetGameInstance();
-#else
-	UGameEngine* engine = Cast<UGameEngine>(GEngine);
-	if (engine) GameInstance = engine->GameInstance;
-#endif
-	return GameInstance;
-}
-
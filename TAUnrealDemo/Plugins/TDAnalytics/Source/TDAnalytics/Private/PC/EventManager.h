@@ -34,16 +34,8 @@ private:
 
 	~UTAEventManager();
 
-	UGameInstance* GetGameInstance();
-
 	FTaskHandle* m_TaskHandle;
 
-	UGameInstance* m_GameInstance;
-
-	FRunnableThread* m_RunnableThread;
-
 	UTDAnalyticsPC* m_Instance;
 
-	FTimerHandle WorkHandle;
-
 };
\ No newline at end of file
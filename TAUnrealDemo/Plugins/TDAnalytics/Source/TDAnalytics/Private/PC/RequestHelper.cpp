@@ -4,26 +4,49 @@
 
 FRequestHelper::FRequestHelper()
 {
+    m_TaskHandle = nullptr;
+    m_EventNum = 0;
+    m_BatchSeq = 0;
+    m_IsDebug = false;
 }
 
-void FRequestHelper::CallHttpRequest(const FString& ServerUrl, const FString& Data, bool IsDebug, FTaskHandle* TaskHandle, uint32 EventNum)
+void FRequestHelper::CallHttpRequest(const FString& ServerUrl, const FString& Data, FTaskHandle* TaskHandle, uint32 EventNum, uint64 DebugSeq)
 {
     // FTALog::Warning(CUR_LOG_POSITION, TEXT("ServerUrl : ") + ServerUrl + TEXT(" Data : ") + Data);
     m_TaskHandle = TaskHandle;
     m_EventNum = EventNum;
-	FTALog::Warning(CUR_LOG_POSITION, TEXT("CallHttpRequest IsDebug: ") + UKismetStringLibrary::Conv_BoolToString(IsDebug));
+    m_BatchSeq = DebugSeq;
+    m_IsDebug = true;
     TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = FHttpModule::Get().CreateRequest();
-    if ( IsDebug )
+    Request->SetHeader("Content-Type", "application/x-www-form-urlencoded;charset=utf-8");
+    Request->SetContentAsString(Data);
+    SendRequest(Request, ServerUrl);
+}
+
+void FRequestHelper::CallHttpRequest(const FString& ServerUrl, TArray<uint8>&& CompressedData, bool Binary, FTaskHandle* TaskHandle, uint32 EventNum, uint64 BatchSeq)
+{
+    m_TaskHandle = TaskHandle;
+    m_EventNum = EventNum;
+    m_BatchSeq = BatchSeq;
+    m_IsDebug = false;
+    TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = FHttpModule::Get().CreateRequest();
+    if ( Binary )
     {
-    	Request->SetHeader("Content-Type", "application/x-www-form-urlencoded;charset=utf-8");
-    	Request->SetContentAsString(Data);
+        // the body moves into the request, no base64 or UTF-16 copy
+        Request->SetHeader("Content-Type", "application/json");
+        Request->SetHeader("Content-Encoding", "gzip");
+        Request->SetContent(MoveTemp(CompressedData));
     }
     else
     {
-		Request->SetHeader("Content-Type", "text/plain");
-        FTALog::Warning(CUR_LOG_POSITION, TEXT("Data : ") + Data);
-		Request->SetContentAsString(FTAUtils::EncodeData(Data));    
+        Request->SetHeader("Content-Type", "text/plain");
+        Request->SetContentAsString(FBase64::Encode(CompressedData));
     }
+    SendRequest(Request, ServerUrl);
+}
+
+void FRequestHelper::SendRequest(TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request, const FString& ServerUrl)
+{
     Request->SetVerb("POST");
     Request->SetTimeout(10000);
     Request->SetURL(ServerUrl);
@@ -32,17 +55,46 @@ void FRequestHelper::CallHttpRequest(const FString& ServerUrl, const FString& Da
     Request->ProcessRequest();
 }
 
+double FRequestHelper::ParseRetryAfter(const FString& Value)
+{
+    // delay-seconds or an HTTP-date
+    if ( Value.IsEmpty() )
+    {
+        return 0;
+    }
+    if ( Value.IsNumeric() )
+    {
+        return FMath::Max(FCString::Atod(*Value), 0.0);
+    }
+    FDateTime RetryTime;
+    if ( FDateTime::ParseHttpDate(Value, RetryTime) )
+    {
+        return FMath::Max((RetryTime - FDateTime::UtcNow()).GetTotalSeconds(), 0.0);
+    }
+    return 0;
+}
+
 void FRequestHelper::RequestComplete(FHttpRequestPtr RequestPtr, FHttpResponsePtr ResponsePtr, bool IsSuccess)
 {
 	/*FTALog::Warning(CUR_LOG_POSITION, TEXT("is success = ") + (UKismetStringLibrary::Conv_BoolToString(IsSuccess)));
     FTALog::Warning(CUR_LOG_POSITION, TEXT("is responseCode = ") + (FString::FromInt(ResponsePtr->GetResponseCode())));
     FTALog::Warning(CUR_LOG_POSITION, TEXT("is content = ") + (ResponsePtr->GetContentAsString()));*/
+    // back to the pool before the handle hears of the completion, the next request of the freed slot always finds
+    // a context. nothing of this context is touched once it is released
+    FTaskHandle* TaskHandle = m_TaskHandle;
+    uint32 EventNum = m_EventNum;
+    uint64 BatchSeq = m_BatchSeq;
+    bool IsDebug = m_IsDebug;
+    m_TaskHandle = nullptr;
+    TaskHandle->ReleaseRequest(this);
+
     if(ResponsePtr.IsValid()){
-        m_TaskHandle->RequestCallback(ResponsePtr->GetContentAsString(), ResponsePtr->GetResponseCode(), IsSuccess, m_EventNum);
-        if ( !EHttpResponseCodes::IsOk(ResponsePtr->GetResponseCode()) )
-        {
-            delete this;
-        }
+        TaskHandle->RequestCallback(ResponsePtr->GetContentAsString(), ResponsePtr->GetResponseCode(), IsSuccess, EventNum, BatchSeq, ParseRetryAfter(ResponsePtr->GetHeader(TEXT("Retry-After"))), IsDebug);
+    }
+    else
+    {
+        // no response at all, the handle still has to release the batch and back off
+        TaskHandle->RequestCallback(TEXT("no response"), 0, false, EventNum, BatchSeq, 0, IsDebug);
     }
 
     // TSharedRef<TJsonReader<TCHAR>> JsonReader = TJsonReaderFactory<TCHAR>::Create(ResponsePtr->GetContentAsString());
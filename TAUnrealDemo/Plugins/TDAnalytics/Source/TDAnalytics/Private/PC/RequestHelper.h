@@ -10,19 +10,33 @@
 #include "Interfaces/IHttpRequest.h"
 #include "Interfaces/IHttpResponse.h"
 
+// context of one upload request, pooled by its FTaskHandle and reused once the request completed
 class FRequestHelper
 {
 public:
 
 	FRequestHelper();
 
-	void CallHttpRequest(const FString& ServerUrl, const FString& Data, bool IsDebug, FTaskHandle* TaskHandle, uint32 EventNum);
+	// form encoded debug request, DebugSeq identifies it in its FTaskHandle's debug queue
+	void CallHttpRequest(const FString& ServerUrl, const FString& Data, FTaskHandle* TaskHandle, uint32 EventNum, uint64 DebugSeq);
+
+	// Binary sends the gzip body as is with Content-Encoding, otherwise base64 text
+	void CallHttpRequest(const FString& ServerUrl, TArray<uint8>&& CompressedData, bool Binary, FTaskHandle* TaskHandle, uint32 EventNum, uint64 BatchSeq);
 
 private:
+
+	void SendRequest(TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request, const FString& ServerUrl);
 	
 	FTaskHandle* m_TaskHandle;
 
 	uint32 m_EventNum;
 
+	uint64 m_BatchSeq;
+
+	bool m_IsDebug;
+
 	void RequestComplete(FHttpRequestPtr RequestPtr, FHttpResponsePtr ResponsePtr, bool IsSuccess);
+
+	// seconds of a Retry-After header, 0 if missing or malformed
+	static double ParseRetryAfter(const FString& Value);
 };
\ No newline at end of file
@@ -0,0 +1,75 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#include "TAEventRecord.h"
+#include "Misc/Crc.h"
+
+static uint32 RecordCrc(uint8 Type, const uint8* Payload, int32 PayloadSize)
+{
+	uint32 Crc = FCrc::MemCrc32(&Type, 1);
+	return FCrc::MemCrc32(Payload, PayloadSize, Crc);
+}
+
+FString FTAEventRecordView::ToString() const
+{
+	FUTF8ToTCHAR Converter((const ANSICHAR*)Payload, PayloadSize);
+	return FString(Converter.Length(), Converter.Get());
+}
+
+void FTAEventRecord::Append(TArray<uint8>& Buffer, const FString& Payload, ETARecordType Type)
+{
+	FTCHARToUTF8 Converter(*Payload, Payload.Len());
+	Append(Buffer, (const uint8*)Converter.Get(), Converter.Length(), (uint8)Type);
+}
+
+void FTAEventRecord::Append(TArray<uint8>& Buffer, const uint8* Payload, int32 PayloadSize, uint8 Type)
+{
+	int32 Offset = Buffer.AddUninitialized(HEADER_SIZE + PayloadSize);
+	uint8* Dest = Buffer.GetData() + Offset;
+	WriteUInt32(Dest, (uint32)PayloadSize);
+	WriteUInt32(Dest + 4, RecordCrc(Type, Payload, PayloadSize));
+	Dest[8] = Type;
+	FMemory::Memcpy(Dest + HEADER_SIZE, Payload, PayloadSize);
+}
+
+ETARecordStatus FTAEventRecord::Decode(const uint8* Data, int64 Size, FTAEventRecordView& OutRecord)
+{
+	if ( Size < HEADER_SIZE )
+	{
+		return ETARecordStatus::Truncated;
+	}
+
+	uint32 PayloadSize = ReadUInt32(Data);
+	if ( PayloadSize > (uint32)MAX_PAYLOAD_SIZE )
+	{
+		return ETARecordStatus::Corrupted;
+	}
+	if ( Size < HEADER_SIZE + (int64)PayloadSize )
+	{
+		return ETARecordStatus::Truncated;
+	}
+
+	uint8 Type = Data[8];
+	const uint8* Payload = Data + HEADER_SIZE;
+	if ( ReadUInt32(Data + 4) != RecordCrc(Type, Payload, PayloadSize) )
+	{
+		return ETARecordStatus::Corrupted;
+	}
+
+	OutRecord.Payload = Payload;
+	OutRecord.PayloadSize = PayloadSize;
+	OutRecord.RecordSize = HEADER_SIZE + PayloadSize;
+	OutRecord.Type = Type;
+	return ETARecordStatus::Valid;
+}
+
+void FTAEventRecord::WriteUInt32(uint8* Dest, uint32 Value)
+{
+	Dest[0] = (uint8)(Value);
+	Dest[1] = (uint8)(Value >> 8);
+	Dest[2] = (uint8)(Value >> 16);
+	Dest[3] = (uint8)(Value >> 24);
+}
+
+uint32 FTAEventRecord::ReadUInt32(const uint8* Src)
+{
+	return (uint32)Src[0] | ((uint32)Src[1] << 8) | ((uint32)Src[2] << 16) | ((uint32)Src[3] << 24);
+}
@@ -0,0 +1,62 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#pragma once
+
+#include "CoreMinimal.h"
+
+// payload encoding, low 4 bits of the record type byte. the high 4 bits are reserved for flags
+enum class ETARecordType : uint8
+{
+	EventJson = 0,
+	// uint32 event count followed by the gzip body of a sealed upload batch
+	GzipBatch = 1,
+	// uint8 app id size, UTF-8 app id, then framed EventJson records of that app id
+	PartitionRecords = 2,
+	// per app id: uint8 app id size, UTF-8 app id, uint64 offset of its first unconsumed record in a held log
+	HeldLogOffsets = 3
+};
+
+enum class ETARecordStatus : uint8
+{
+	Valid,
+	Truncated,
+	Corrupted
+};
+
+// a decoded record. Payload points into the buffer it was decoded from, nothing is copied
+struct FTAEventRecordView
+{
+	const uint8* Payload = nullptr;
+
+	int32 PayloadSize = 0;
+
+	int32 RecordSize = 0;
+
+	uint8 Type = 0;
+
+	FString ToString() const;
+};
+
+/**
+ * Binary record framing used for cached events (little endian):
+ * | uint32 payload size | uint32 crc32(type + payload) | uint8 type | payload (UTF-8) |
+ */
+class FTAEventRecord
+{
+public:
+
+	const static uint8 FORMAT_VERSION = 1;
+
+	const static int32 HEADER_SIZE = 9;
+
+	const static int32 MAX_PAYLOAD_SIZE = 16 * 1024 * 1024;
+
+	static void Append(TArray<uint8>& Buffer, const FString& Payload, ETARecordType Type = ETARecordType::EventJson);
+
+	static void Append(TArray<uint8>& Buffer, const uint8* Payload, int32 PayloadSize, uint8 Type);
+
+	static ETARecordStatus Decode(const uint8* Data, int64 Size, FTAEventRecordView& OutRecord);
+
+	static void WriteUInt32(uint8* Dest, uint32 Value);
+
+	static uint32 ReadUInt32(const uint8* Src);
+};
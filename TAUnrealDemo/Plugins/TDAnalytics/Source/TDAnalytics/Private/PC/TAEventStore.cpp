@@ -0,0 +1,1557 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#include "TAEventStore.h"
+#include "TAFileWriter.h"
+#include "../Common/TALog.h"
+#include "../Common/TAConstants.h"
+#include "TDAnalyticsSettings.h"
+
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/Crc.h"
+
+static const uint8 FILE_MAGIC[4] = { 'T', 'D', 'A', 'S' };
+static const uint8 FILE_KIND_LOG = 0;
+static const uint8 FILE_KIND_BATCH = 1;
+static const TCHAR* LOG_EXTENSION = TEXT("tdlog");
+static const TCHAR* BATCH_EXTENSION = TEXT("tdbatch");
+static const TCHAR* CURSOR_EXTENSION = TEXT("tdcursor");
+static const TCHAR* META_EXTENSION = TEXT("tdmeta");
+static const TCHAR* HOLD_EXTENSION = TEXT("tdhold");
+static const uint8 CURSOR_MAGIC[4] = { 'T', 'D', 'A', 'C' };
+// | "TDAC" | uint8 version | 3 reserved | uint64 generation | uint64 log seq | uint32 partition count | partitions | uint32 crc32 |
+// partition: | uint8 app id size | UTF-8 app id | uint64 ack seq | uint64 consumed offset |
+static const uint8 CURSOR_VERSION = 2;
+static const int32 CURSOR_HEADER_SIZE = 28;
+static const double COMPACT_INTERVAL = 5.0;
+
+static void WriteUInt64(uint8* Dest, uint64 Value)
+{
+	FTAEventRecord::WriteUInt32(Dest, (uint32)Value);
+	FTAEventRecord::WriteUInt32(Dest + 4, (uint32)(Value >> 32));
+}
+
+static uint64 ReadUInt64(const uint8* Src)
+{
+	return (uint64)FTAEventRecord::ReadUInt32(Src) | ((uint64)FTAEventRecord::ReadUInt32(Src + 4) << 32);
+}
+
+static void WriteFileHeader(TArray<uint8>& Buffer, uint8 Kind, uint8 Priority, uint64 SourceSeq, uint64 SourceOffset, int64 CreateTime = 0)
+{
+	int32 Offset = Buffer.AddZeroed(FTAEventStore::FILE_HEADER_SIZE);
+	uint8* Dest = Buffer.GetData() + Offset;
+	FMemory::Memcpy(Dest, FILE_MAGIC, 4);
+	Dest[4] = FTAEventRecord::FORMAT_VERSION;
+	Dest[5] = Kind;
+	Dest[6] = Priority;
+	WriteUInt64(Dest + 8, (uint64)(CreateTime > 0 ? CreateTime : FDateTime::UtcNow().ToUnixTimestamp()));
+	WriteUInt64(Dest + 16, SourceSeq);
+	WriteUInt64(Dest + 24, SourceOffset);
+}
+
+static bool IsValidFileHeader(const uint8* Data, int64 Size, uint8 Kind)
+{
+	return Size >= FTAEventStore::FILE_HEADER_SIZE && FMemory::Memcmp(Data, FILE_MAGIC, 4) == 0 && Data[4] <= FTAEventRecord::FORMAT_VERSION && Data[5] == Kind;
+}
+
+// events of the commit groups from the first invalid one on, for reporting only. a group is dropped as a whole,
+// its events are counted by their record headers as far as they were written, a group without one counts as one
+static uint32 CountTornEvents(const uint8* Data, int64 Size)
+{
+	uint32 Count = 0;
+	int64 Offset = 0;
+	while ( Offset < Size )
+	{
+		uint32 GroupNum = 0;
+		int64 GroupEnd = Size;
+		uint32 PayloadSize = Size - Offset > FTAEventRecord::HEADER_SIZE ? FTAEventRecord::ReadUInt32(Data + Offset) : 0;
+		if ( PayloadSize > 0 && PayloadSize <= (uint32)FTAEventRecord::MAX_PAYLOAD_SIZE )
+		{
+			GroupEnd = FMath::Min(Size, Offset + FTAEventRecord::HEADER_SIZE + (int64)PayloadSize);
+			// | app id size | app id | records |
+			int64 RecordOffset = Offset + FTAEventRecord::HEADER_SIZE + 1 + Data[Offset + FTAEventRecord::HEADER_SIZE];
+			while ( RecordOffset < GroupEnd )
+			{
+				GroupNum++;
+				uint32 RecordSize = GroupEnd - RecordOffset >= FTAEventRecord::HEADER_SIZE ? FTAEventRecord::ReadUInt32(Data + RecordOffset) : MAX_uint32;
+				if ( RecordSize > (uint32)FTAEventRecord::MAX_PAYLOAD_SIZE )
+				{
+					break;
+				}
+				RecordOffset += FTAEventRecord::HEADER_SIZE + RecordSize;
+			}
+		}
+		Count += FMath::Max(GroupNum, 1u);
+		Offset = GroupEnd;
+	}
+	return Count;
+}
+
+// temp file + rename, the destination never holds a partial segment
+static bool WriteFileAtomic(const FString& Path, const TArray<uint8>& Data)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	FString TempPath = Path + TEXT(".tmp");
+	IFileHandle* Handle = PlatformFile.OpenWrite(*TempPath, false, false);
+	if ( !Handle )
+	{
+		return false;
+	}
+	bool Result = Handle->Write(Data.GetData(), Data.Num()) && Handle->Flush(true);
+	delete Handle;
+	// MoveFile does not replace an existing file on every platform, meta files are rewritten in place
+	if ( !Result || !IFileManager::Get().Move(*Path, *TempPath, true, false, false, true) )
+	{
+		PlatformFile.DeleteFile(*TempPath);
+		return false;
+	}
+	return true;
+}
+
+FTAStorageEngine& FTAStorageEngine::Get()
+{
+	static FTAStorageEngine* Engine = new FTAStorageEngine(FPaths::ProjectSavedDir() / FString(FTAConstants::EVENT_STORE_DIR));
+	return *Engine;
+}
+
+FTAStorageEngine::FTAStorageEngine(const FString& Directory)
+	: FTAStorageEngine(Directory, GetDefault<UTDAnalyticsSettings>()->ExecutionMode == TAExecutionMode::TASK_GRAPH)
+{
+}
+
+FTAStorageEngine::FTAStorageEngine(const FString& Directory, bool UseTaskGraph)
+{
+	m_Directory = Directory;
+	m_Writer = new FTAFileWriter(TEXT("TDAnalyticsIO"), UseTaskGraph);
+	m_NextSeq = 1;
+	m_LogSeq = 0;
+	m_NeedRewrite = false;
+	m_CursorGeneration = 0;
+	m_CursorDirty = false;
+	m_LastCompactTime = 0;
+	m_LogCreateTime = FDateTime::UtcNow().ToUnixTimestamp();
+	m_LogHandle = nullptr;
+	m_LogHandleSeq = 0;
+	m_FailedLogSeq = 0;
+
+	//lock
+	FScopeLock EngineLock(&m_Critical);
+	Recover();
+}
+
+FTAStorageEngine::~FTAStorageEngine()
+{
+	delete m_Writer;
+	m_Writer = nullptr;
+	CloseLog();
+	for (auto& Pair : m_Partitions)
+	{
+		delete Pair.Value;
+	}
+	m_Partitions.Empty();
+}
+
+FTAEventStore* FTAStorageEngine::OpenPartition(const FString& AppID)
+{
+	//lock
+	FScopeLock EngineLock(&m_Critical);
+	return FindOrAddPartition(AppID);
+}
+
+void FTAStorageEngine::Shutdown()
+{
+	{
+		//lock
+		FScopeLock EngineLock(&m_Critical);
+		Commit();
+		if ( m_CursorDirty )
+		{
+			WriteCursor();
+		}
+	}
+	m_Writer->Shutdown();
+	CloseLog();
+	if ( m_WriteFailed )
+	{
+		FTALog::Warning(CUR_LOG_POSITION, TEXT("Event store shut down with failed writes !"));
+	}
+}
+
+FTAEventStore* FTAStorageEngine::FindOrAddPartition(const FString& AppID)
+{
+	FTAEventStore** Found = m_Partitions.Find(AppID);
+	if ( Found )
+	{
+		return *Found;
+	}
+
+	FCursorEntry* Entry = m_RecoveredCursor.Find(AppID);
+	FTAEventStore* Partition = new FTAEventStore(this, AppID, Entry ? Entry->AckSeq : 0);
+	m_NextSeq = FMath::Max(m_NextSeq, Partition->Recover() + 1);
+	m_Partitions.Add(AppID, Partition);
+	return Partition;
+}
+
+FString FTAStorageEngine::GetLogPath(uint64 Seq)
+{
+	return m_Directory / FString::Printf(TEXT("%020llu.%s"), Seq, LOG_EXTENSION);
+}
+
+FString FTAStorageEngine::GetCursorPath(int32 Slot)
+{
+	return m_Directory / FString::Printf(TEXT("cursor%d.%s"), Slot, CURSOR_EXTENSION);
+}
+
+FString FTAStorageEngine::GetHoldPath(uint64 Seq)
+{
+	return m_Directory / FString::Printf(TEXT("%020llu.%s"), Seq, HOLD_EXTENSION);
+}
+
+void FTAStorageEngine::Recover()
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.CreateDirectoryTree(*m_Directory);
+
+	uint64 CursorLogSeq = 0;
+	bool HasCursor = ReadCursor(CursorLogSeq);
+	if ( HasCursor )
+	{
+		// seqs never go back: once everything is acknowledged and compacted no file is left to recover them from
+		m_NextSeq = FMath::Max(m_NextSeq, CursorLogSeq + 1);
+		for (auto& Pair : m_RecoveredCursor)
+		{
+			m_NextSeq = FMath::Max(m_NextSeq, Pair.Value.AckSeq);
+		}
+	}
+
+	TArray<FString> FileNames;
+	IFileManager::Get().FindFiles(FileNames, *(m_Directory / TEXT("*")), true, false);
+	TArray<uint64> LogSeqs;
+	TArray<uint64> HoldSeqs;
+	for (const FString& FileName : FileNames)
+	{
+		FString Extension = FPaths::GetExtension(FileName);
+		uint64 Seq = FCString::Strtoui64(*FPaths::GetBaseFilename(FileName), nullptr, 10);
+		if ( Extension == CURSOR_EXTENSION )
+		{
+			continue;
+		}
+		else if ( Extension == LOG_EXTENSION && Seq > 0 )
+		{
+			LogSeqs.Add(Seq);
+			m_NextSeq = FMath::Max(m_NextSeq, Seq + 1);
+		}
+		else if ( Extension == HOLD_EXTENSION && Seq > 0 )
+		{
+			HoldSeqs.Add(Seq);
+		}
+		else
+		{
+			// interrupted atomic writes
+			PlatformFile.DeleteFile(*(m_Directory / FileName));
+		}
+	}
+	LogSeqs.Sort();
+
+	// every partition on disk, also app ids that are not initialized in this run
+	TArray<FString> DirNames;
+	IFileManager::Get().FindFiles(DirNames, *(m_Directory / TEXT("*")), false, true);
+	for (const FString& DirName : DirNames)
+	{
+		FindOrAddPartition(DirName);
+	}
+
+	// a held log stays until its records are in the live log, a marker without its log is done
+	TArray<uint64> LiveSeqs;
+	for (uint64 Seq : LogSeqs)
+	{
+		if ( HoldSeqs.Contains(Seq) )
+		{
+			TMap<FString, uint64>& SkipOffsets = m_HeldLogs.Add(Seq);
+			if ( !ReadHoldMarker(Seq, SkipOffsets) )
+			{
+				// the progress is gone, sending events twice beats losing them
+				SkipOffsets.Empty();
+			}
+		}
+		else
+		{
+			LiveSeqs.Add(Seq);
+		}
+	}
+	for (uint64 Seq : HoldSeqs)
+	{
+		if ( !m_HeldLogs.Contains(Seq) )
+		{
+			PlatformFile.DeleteFile(*GetHoldPath(Seq));
+		}
+	}
+
+	uint32 LostNum = 0;
+	bool Clean = true;
+	if ( LiveSeqs.Num() > 0 )
+	{
+		// only the newest log is live, older ones are leftovers of a rotation or rewrite.
+		// a log newer than the cursor was switched to but the cursor write did not land, it holds everything unconsumed
+		for (int32 i = 0; i < LiveSeqs.Num() - 1; i++)
+		{
+			PlatformFile.DeleteFile(*GetLogPath(LiveSeqs[i]));
+		}
+		m_LogSeq = LiveSeqs.Last();
+		ELogRecovery Recovery = RecoverLog(m_LogSeq, LostNum);
+		if ( Recovery == ELogRecovery::Unreadable )
+		{
+			// a failed read says nothing about the records: keep the log with its progress, new events go to a fresh segment
+			TMap<FString, uint64> SkipOffsets;
+			for (auto& Pair : m_Partitions)
+			{
+				uint64 SkipOffset = 0;
+				uint64* SealedOffset = Pair.Value->m_SealedOffsets.Find(m_LogSeq);
+				if ( SealedOffset )
+				{
+					SkipOffset = *SealedOffset;
+				}
+				FCursorEntry* Entry = m_RecoveredCursor.Find(Pair.Key);
+				if ( HasCursor && CursorLogSeq == m_LogSeq && Entry )
+				{
+					SkipOffset = FMath::Max(SkipOffset, Entry->Consumed);
+				}
+				SkipOffsets.Add(Pair.Key, SkipOffset);
+			}
+			HoldLog(m_LogSeq, SkipOffsets);
+			FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Event log %llu is not readable, keep it and retry later"), m_LogSeq));
+			m_LogSeq = m_NextSeq++;
+		}
+		Clean = Recovery != ELogRecovery::Torn;
+	}
+	else
+	{
+		m_LogSeq = m_NextSeq++;
+	}
+
+	uint32 RecoveredNum = 0;
+	uint32 BatchNum = 0;
+	for (auto& Pair : m_Partitions)
+	{
+		FTAEventStore* Partition = Pair.Value;
+		uint64 SkipOffset = 0;
+		uint64* SealedOffset = Partition->m_SealedOffsets.Find(m_LogSeq);
+		if ( SealedOffset )
+		{
+			SkipOffset = *SealedOffset;
+		}
+		FCursorEntry* Entry = m_RecoveredCursor.Find(Pair.Key);
+		if ( HasCursor && CursorLogSeq == m_LogSeq && Entry )
+		{
+			SkipOffset = FMath::Max(SkipOffset, Entry->Consumed);
+		}
+		Partition->ApplyRecoveredOffset(SkipOffset);
+		RecoveredNum += Partition->m_PendingNum;
+		BatchNum += Partition->m_Batches.Num();
+	}
+	m_RecoveredCursor.Empty();
+
+	if ( ImportHeldLogs() )
+	{
+		// the imported records reach the disk with the rewrite, the held logs go after it
+		Clean = false;
+	}
+
+	if ( Clean )
+	{
+		// the log is intact or there is none yet, keep appending to it
+		WriteCursor();
+	}
+	else
+	{
+		// drop the torn tail with a rewrite into a fresh log
+		RewriteLog();
+	}
+
+	if ( RecoveredNum > 0 || BatchNum > 0 || LostNum > 0 )
+	{
+		FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Event store recovered %d events and %d batches of %d app ids, lost %d events"), RecoveredNum, BatchNum, m_Partitions.Num(), LostNum));
+	}
+}
+
+FTAStorageEngine::ELogRecovery FTAStorageEngine::RecoverLog(uint64 Seq, uint32& OutLostNum)
+{
+	TArray<uint8> Data;
+	if ( !FFileHelper::LoadFileToArray(Data, *GetLogPath(Seq)) )
+	{
+		return ELogRecovery::Unreadable;
+	}
+
+	TMap<FString, TArray<uint8>> Records;
+	bool Intact = ReadLogRecords(Data, Records, OutLostNum);
+	for (auto& Pair : Records)
+	{
+		FindOrAddPartition(Pair.Key)->m_LogRecords.Append(Pair.Value);
+	}
+	if ( IsValidFileHeader(Data.GetData(), Data.Num(), FILE_KIND_LOG) )
+	{
+		m_LogCreateTime = (int64)ReadUInt64(Data.GetData() + 8);
+	}
+	return Intact ? ELogRecovery::Intact : ELogRecovery::Torn;
+}
+
+bool FTAStorageEngine::ReadLogRecords(const TArray<uint8>& Data, TMap<FString, TArray<uint8>>& OutRecords, uint32& OutLostNum)
+{
+	if ( !IsValidFileHeader(Data.GetData(), Data.Num(), FILE_KIND_LOG) )
+	{
+		if ( Data.Num() > FTAEventStore::FILE_HEADER_SIZE )
+		{
+			OutLostNum += CountTornEvents(Data.GetData() + FTAEventStore::FILE_HEADER_SIZE, Data.Num() - FTAEventStore::FILE_HEADER_SIZE);
+		}
+		return false;
+	}
+
+	int64 Offset = FTAEventStore::FILE_HEADER_SIZE;
+	FTAEventRecordView Record;
+	while ( Offset < Data.Num() )
+	{
+		if ( FTAEventRecord::Decode(Data.GetData() + Offset, Data.Num() - Offset, Record) != ETARecordStatus::Valid )
+		{
+			// torn tail: keep every commit group before it
+			OutLostNum += CountTornEvents(Data.GetData() + Offset, Data.Num() - Offset);
+			return false;
+		}
+		Offset += Record.RecordSize;
+
+		int32 AppIDSize = Record.PayloadSize > 0 ? Record.Payload[0] : 0;
+		if ( Record.Type != (uint8)ETARecordType::PartitionRecords || AppIDSize == 0 || 1 + AppIDSize > Record.PayloadSize )
+		{
+			continue;
+		}
+		FUTF8ToTCHAR Converter((const ANSICHAR*)(Record.Payload + 1), AppIDSize);
+		OutRecords.FindOrAdd(FString(Converter.Length(), Converter.Get())).Append(Record.Payload + 1 + AppIDSize, Record.PayloadSize - 1 - AppIDSize);
+	}
+	return true;
+}
+
+void FTAStorageEngine::HoldLog(uint64 Seq, const TMap<FString, uint64>& SkipOffsets)
+{
+	TArray<uint8> Payload;
+	for (const auto& Pair : SkipOffsets)
+	{
+		FTCHARToUTF8 Converter(*Pair.Key, Pair.Key.Len());
+		int32 AppIDSize = FMath::Min(Converter.Length(), 255);
+		Payload.Add((uint8)AppIDSize);
+		Payload.Append((const uint8*)Converter.Get(), AppIDSize);
+		int32 Offset = Payload.AddZeroed(8);
+		WriteUInt64(Payload.GetData() + Offset, Pair.Value);
+	}
+	TArray<uint8> Data;
+	FTAEventRecord::Append(Data, Payload.GetData(), Payload.Num(), (uint8)ETARecordType::HeldLogOffsets);
+	m_HeldLogs.Add(Seq, SkipOffsets);
+
+	// written right away like the rest of the recovery, it has to be on disk before the cursor moves to the next segment
+	if ( !WriteFileAtomic(GetHoldPath(Seq), Data) )
+	{
+		FTALog::Warning(CUR_LOG_POSITION, TEXT("Write event log hold marker failed, the held log is kept for this run only !"));
+	}
+}
+
+bool FTAStorageEngine::ReadHoldMarker(uint64 Seq, TMap<FString, uint64>& OutSkipOffsets)
+{
+	TArray<uint8> Data;
+	FTAEventRecordView Record;
+	if ( !FFileHelper::LoadFileToArray(Data, *GetHoldPath(Seq), FILEREAD_Silent)
+		|| FTAEventRecord::Decode(Data.GetData(), Data.Num(), Record) != ETARecordStatus::Valid
+		|| Record.Type != (uint8)ETARecordType::HeldLogOffsets )
+	{
+		return false;
+	}
+
+	int32 Offset = 0;
+	while ( Offset < Record.PayloadSize )
+	{
+		int32 AppIDSize = Record.Payload[Offset];
+		if ( AppIDSize == 0 || Offset + 1 + AppIDSize + 8 > Record.PayloadSize )
+		{
+			return false;
+		}
+		FUTF8ToTCHAR Converter((const ANSICHAR*)(Record.Payload + Offset + 1), AppIDSize);
+		OutSkipOffsets.Add(FString(Converter.Length(), Converter.Get()), ReadUInt64(Record.Payload + Offset + 1 + AppIDSize));
+		Offset += 1 + AppIDSize + 8;
+	}
+	return true;
+}
+
+bool FTAStorageEngine::ImportHeldLogs()
+{
+	uint32 ImportedNum = 0;
+	uint32 LostNum = 0;
+	bool Imported = false;
+	for (auto It = m_HeldLogs.CreateIterator(); It; ++It)
+	{
+		TArray<uint8> Data;
+		if ( !FFileHelper::LoadFileToArray(Data, *GetLogPath(It.Key()), FILEREAD_Silent) )
+		{
+			continue;
+		}
+
+		// a torn tail is dropped as in the live log
+		TMap<FString, TArray<uint8>> Records;
+		ReadLogRecords(Data, Records, LostNum);
+		int64 CreateTime = Data.Num() >= FTAEventStore::FILE_HEADER_SIZE ? (int64)ReadUInt64(Data.GetData() + 8) : 0;
+		for (auto& Pair : Records)
+		{
+			uint64* SkipOffset = It.Value().Find(Pair.Key);
+			ImportedNum += FindOrAddPartition(Pair.Key)->ImportRecords(Pair.Value, SkipOffset ? *SkipOffset : 0, CreateTime);
+		}
+		m_ImportedLogSeqs.Add(It.Key());
+		It.RemoveCurrent();
+		Imported = true;
+	}
+
+	if ( Imported )
+	{
+		FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Event store imported %d events of held logs, lost %d events"), ImportedNum, LostNum));
+	}
+	return Imported;
+}
+
+void FTAStorageEngine::DeleteImportedLogs(const TArray<uint64>& Seqs)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	for (uint64 Seq : Seqs)
+	{
+		PlatformFile.DeleteFile(*GetLogPath(Seq));
+		PlatformFile.DeleteFile(*GetHoldPath(Seq));
+	}
+
+	//lock
+	FScopeLock EngineLock(&m_Critical);
+	for (uint64 Seq : Seqs)
+	{
+		m_ImportedLogSeqs.Remove(Seq);
+	}
+}
+
+bool FTAStorageEngine::ReadCursor(uint64& OutLogSeq)
+{
+	uint64 Generation = 0;
+	bool Found = false;
+	for (int32 Slot = 0; Slot < 2; Slot++)
+	{
+		TArray<uint8> Data;
+		if ( !FFileHelper::LoadFileToArray(Data, *GetCursorPath(Slot), FILEREAD_Silent) || Data.Num() < CURSOR_HEADER_SIZE + 4
+			|| FMemory::Memcmp(Data.GetData(), CURSOR_MAGIC, 4) != 0 || Data[4] != CURSOR_VERSION
+			|| FTAEventRecord::ReadUInt32(Data.GetData() + Data.Num() - 4) != FCrc::MemCrc32(Data.GetData(), Data.Num() - 4) )
+		{
+			continue;
+		}
+
+		uint64 SlotGeneration = ReadUInt64(Data.GetData() + 8);
+		if ( Found && SlotGeneration <= Generation )
+		{
+			continue;
+		}
+
+		TMap<FString, FCursorEntry> Entries;
+		uint32 EntryNum = FTAEventRecord::ReadUInt32(Data.GetData() + 24);
+		int32 Offset = CURSOR_HEADER_SIZE;
+		bool Valid = true;
+		for (uint32 i = 0; i < EntryNum && Valid; i++)
+		{
+			int32 AppIDSize = Offset < Data.Num() - 4 ? Data[Offset] : 0;
+			Valid = AppIDSize > 0 && Offset + 1 + AppIDSize + 16 <= Data.Num() - 4;
+			if ( Valid )
+			{
+				FUTF8ToTCHAR Converter((const ANSICHAR*)(Data.GetData() + Offset + 1), AppIDSize);
+				FCursorEntry& Entry = Entries.Add(FString(Converter.Length(), Converter.Get()));
+				Entry.AckSeq = ReadUInt64(Data.GetData() + Offset + 1 + AppIDSize);
+				Entry.Consumed = ReadUInt64(Data.GetData() + Offset + 1 + AppIDSize + 8);
+				Offset += 1 + AppIDSize + 16;
+			}
+		}
+		if ( Valid )
+		{
+			Found = true;
+			Generation = SlotGeneration;
+			OutLogSeq = ReadUInt64(Data.GetData() + 16);
+			m_RecoveredCursor = MoveTemp(Entries);
+		}
+	}
+	m_CursorGeneration = Generation;
+	return Found;
+}
+
+void FTAStorageEngine::WriteCursor()
+{
+	TArray<uint8> Data;
+	int32 Slot = BuildCursor(Data);
+	m_Writer->Enqueue([this, Slot, Data]()
+	{
+		WriteCursorFile(Slot, Data);
+	});
+	m_CursorDirty = false;
+}
+
+int32 FTAStorageEngine::BuildCursor(TArray<uint8>& OutData)
+{
+	m_CursorGeneration++;
+	OutData.Reset();
+	OutData.AddZeroed(CURSOR_HEADER_SIZE);
+	FMemory::Memcpy(OutData.GetData(), CURSOR_MAGIC, 4);
+	OutData[4] = CURSOR_VERSION;
+	WriteUInt64(OutData.GetData() + 8, m_CursorGeneration);
+	WriteUInt64(OutData.GetData() + 16, m_LogSeq);
+	FTAEventRecord::WriteUInt32(OutData.GetData() + 24, m_Partitions.Num());
+	for (auto& Pair : m_Partitions)
+	{
+		FTCHARToUTF8 Converter(*Pair.Key, Pair.Key.Len());
+		int32 AppIDSize = FMath::Min(Converter.Length(), 255);
+		OutData.Add((uint8)AppIDSize);
+		OutData.Append((const uint8*)Converter.Get(), AppIDSize);
+		int32 Offset = OutData.AddZeroed(16);
+		WriteUInt64(OutData.GetData() + Offset, Pair.Value->m_AckSeq);
+		WriteUInt64(OutData.GetData() + Offset + 8, Pair.Value->m_LogConsumed);
+	}
+	int32 Offset = OutData.AddZeroed(4);
+	FTAEventRecord::WriteUInt32(OutData.GetData() + Offset, FCrc::MemCrc32(OutData.GetData(), Offset));
+	return (int32)(m_CursorGeneration & 1);
+}
+
+void FTAStorageEngine::WriteCursorFile(int32 Slot, const TArray<uint8>& Data)
+{
+	// two slots written alternately, a torn write leaves the other one valid
+	IFileHandle* Handle = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*GetCursorPath(Slot), false, false);
+	bool Result = Handle && Handle->Write(Data.GetData(), Data.Num()) && Handle->Flush(true);
+	delete Handle;
+	if ( !Result )
+	{
+		FTALog::Warning(CUR_LOG_POSITION, TEXT("Write event cursor failed !"));
+	}
+}
+
+void FTAStorageEngine::AppendPartitionRecords(TArray<uint8>& Buffer, const FString& AppID, const uint8* Records, int32 Size)
+{
+	FTCHARToUTF8 Converter(*AppID, AppID.Len());
+	int32 AppIDSize = FMath::Min(Converter.Length(), 255);
+	int32 Offset = 0;
+	FTAEventRecordView Record;
+	while ( Offset < Size )
+	{
+		// split at record boundaries below the record size limit
+		int32 End = Offset;
+		while ( End < Size && FTAEventRecord::Decode(Records + End, Size - End, Record) == ETARecordStatus::Valid
+			&& (End == Offset || 1 + AppIDSize + End - Offset + Record.RecordSize <= FTAEventRecord::MAX_PAYLOAD_SIZE) )
+		{
+			End += Record.RecordSize;
+		}
+		if ( End == Offset )
+		{
+			return;
+		}
+
+		TArray<uint8> Payload;
+		Payload.Reserve(1 + AppIDSize + End - Offset);
+		Payload.Add((uint8)AppIDSize);
+		Payload.Append((const uint8*)Converter.Get(), AppIDSize);
+		Payload.Append(Records + Offset, End - Offset);
+		FTAEventRecord::Append(Buffer, Payload.GetData(), Payload.Num(), (uint8)ETARecordType::PartitionRecords);
+		Offset = End;
+	}
+}
+
+bool FTAStorageEngine::Commit()
+{
+	if ( m_WriteFailed )
+	{
+		// the I/O thread gave up on the current log, start a fresh one
+		m_WriteFailed = false;
+		m_NeedRewrite = true;
+	}
+	if ( m_NeedRewrite )
+	{
+		RewriteLog();
+		return true;
+	}
+
+	// one write and one flush for every partition
+	TArray<uint8> Group;
+	for (auto& Pair : m_Partitions)
+	{
+		FTAEventStore* Partition = Pair.Value;
+		if ( Partition->m_LogCommitted < Partition->m_LogRecords.Num() )
+		{
+			AppendPartitionRecords(Group, Partition->m_AppID, Partition->m_LogRecords.GetData() + Partition->m_LogCommitted, Partition->m_LogRecords.Num() - Partition->m_LogCommitted);
+			Partition->m_LogCommitted = Partition->m_LogRecords.Num();
+		}
+	}
+	if ( Group.Num() > 0 )
+	{
+		uint64 Seq = m_LogSeq;
+		m_Writer->Enqueue([this, Seq, Group]()
+		{
+			AppendLogFile(Seq, Group);
+		});
+	}
+	if ( m_CursorDirty )
+	{
+		WriteCursor();
+	}
+	return true;
+}
+
+bool FTAStorageEngine::Sync()
+{
+	m_Writer->Flush();
+	return !m_WriteFailed;
+}
+
+void FTAStorageEngine::SyncAsync(TFunction<void(bool)>&& OnSynced)
+{
+	// the writer runs tasks in order, this one runs after every write queued before it
+	m_Writer->Enqueue([this, OnSynced = MoveTemp(OnSynced)]()
+	{
+		OnSynced(!m_WriteFailed);
+	});
+}
+
+void FTAStorageEngine::AppendLogFile(uint64 Seq, const TArray<uint8>& Records)
+{
+	if ( Seq == m_FailedLogSeq )
+	{
+		// a rewrite of this log is queued
+		return;
+	}
+
+	if ( m_LogHandle && m_LogHandleSeq != Seq )
+	{
+		CloseLog();
+	}
+	if ( !m_LogHandle )
+	{
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		FString LogPath = GetLogPath(Seq);
+		if ( PlatformFile.FileExists(*LogPath) )
+		{
+			m_LogHandle = PlatformFile.OpenWrite(*LogPath, true, false);
+		}
+		else
+		{
+			m_LogHandle = PlatformFile.OpenWrite(*LogPath, false, false);
+			TArray<uint8> Header;
+			WriteFileHeader(Header, FILE_KIND_LOG, 0, 0, 0);
+			if ( m_LogHandle && !m_LogHandle->Write(Header.GetData(), Header.Num()) )
+			{
+				CloseLog();
+			}
+		}
+		m_LogHandleSeq = Seq;
+		if ( !m_LogHandle )
+		{
+			m_FailedLogSeq = Seq;
+			m_WriteFailed = true;
+			FTALog::Warning(CUR_LOG_POSITION, TEXT("Open event log failed !"));
+			return;
+		}
+	}
+
+	if ( !m_LogHandle->Write(Records.GetData(), Records.Num()) || !m_LogHandle->Flush(true) )
+	{
+		// the tail may be torn now, the next commit writes a fresh segment
+		CloseLog();
+		m_FailedLogSeq = Seq;
+		m_WriteFailed = true;
+		FTALog::Warning(CUR_LOG_POSITION, TEXT("Write event log failed !"));
+	}
+}
+
+void FTAStorageEngine::TrimLog(bool Force)
+{
+	int64 Consumed = 0;
+	int64 Total = 0;
+	for (auto& Pair : m_Partitions)
+	{
+		Consumed += Pair.Value->m_LogConsumed;
+		Total += Pair.Value->m_LogRecords.Num();
+	}
+
+	if ( Total > 0 && Consumed == Total )
+	{
+		RotateLog();
+	}
+	else if ( Force && Consumed > 0 && Consumed * 2 >= Total )
+	{
+		RewriteLog();
+	}
+}
+
+void FTAStorageEngine::RewriteLog()
+{
+	uint64 OldSeq = m_LogSeq;
+	uint64 NewSeq = m_NextSeq++;
+
+	// the header keeps the time of the oldest pending record, recovery dates the records by it
+	int64 CreateTime = 0;
+	for (auto& Pair : m_Partitions)
+	{
+		FTAEventStore* Partition = Pair.Value;
+		Partition->TrimRecordTimes();
+		for (FTAEventStore::FRecordTime& RecordTime : Partition->m_RecordTimes)
+		{
+			CreateTime = CreateTime > 0 ? FMath::Min(CreateTime, RecordTime.Time) : RecordTime.Time;
+			RecordTime.Offset = FMath::Max(RecordTime.Offset - Partition->m_LogConsumed, 0);
+		}
+	}
+
+	TArray<uint8> Data;
+	WriteFileHeader(Data, FILE_KIND_LOG, 0, 0, 0, CreateTime);
+	for (auto& Pair : m_Partitions)
+	{
+		FTAEventStore* Partition = Pair.Value;
+		AppendPartitionRecords(Data, Partition->m_AppID, Partition->m_LogRecords.GetData() + Partition->m_LogConsumed, Partition->m_LogRecords.Num() - Partition->m_LogConsumed);
+		Partition->m_LogRecords.RemoveAt(0, Partition->m_LogConsumed, false);
+		Partition->m_LogConsumed = 0;
+		Partition->m_LogCommitted = Partition->m_LogRecords.Num();
+	}
+	m_LogSeq = NewSeq;
+	m_NeedRewrite = false;
+
+	// the cursor switches only once the new log is on disk, the old log goes last. imported held logs
+	// stay until a rewrite lands, a failed one is retried with their records still in memory
+	TArray<uint8> Cursor;
+	int32 Slot = BuildCursor(Cursor);
+	m_CursorDirty = false;
+	TArray<uint64> ImportedSeqs = m_ImportedLogSeqs;
+	m_Writer->Enqueue([this, OldSeq, NewSeq, Data, Cursor, Slot, ImportedSeqs]()
+	{
+		if ( !WriteFileAtomic(GetLogPath(NewSeq), Data) )
+		{
+			m_FailedLogSeq = NewSeq;
+			m_WriteFailed = true;
+			FTALog::Warning(CUR_LOG_POSITION, TEXT("Rewrite event log failed !"));
+			return;
+		}
+		CloseLog();
+		WriteCursorFile(Slot, Cursor);
+		FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*GetLogPath(OldSeq));
+		DeleteImportedLogs(ImportedSeqs);
+	});
+}
+
+void FTAStorageEngine::RotateLog()
+{
+	uint64 OldSeq = m_LogSeq;
+	for (auto& Pair : m_Partitions)
+	{
+		Pair.Value->m_LogRecords.Reset();
+		Pair.Value->m_LogConsumed = 0;
+		Pair.Value->m_LogCommitted = 0;
+		Pair.Value->m_RecordTimes.Reset();
+	}
+	m_LogSeq = m_NextSeq++;
+	m_NeedRewrite = false;
+	WriteCursor();
+	// every record is consumed, imported ones included
+	TArray<uint64> ImportedSeqs = m_ImportedLogSeqs;
+	m_Writer->Enqueue([this, OldSeq, ImportedSeqs]()
+	{
+		CloseLog();
+		FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*GetLogPath(OldSeq));
+		DeleteImportedLogs(ImportedSeqs);
+	});
+}
+
+void FTAStorageEngine::CloseLog()
+{
+	if ( m_LogHandle )
+	{
+		delete m_LogHandle;
+		m_LogHandle = nullptr;
+	}
+}
+
+void FTAStorageEngine::Compact()
+{
+	// one schedule for every partition
+	double Now = FPlatformTime::Seconds();
+	if ( Now - m_LastCompactTime < COMPACT_INTERVAL )
+	{
+		return;
+	}
+	m_LastCompactTime = Now;
+
+	if ( m_HeldLogs.Num() > 0 && ImportHeldLogs() )
+	{
+		RewriteLog();
+	}
+
+	for (auto& Pair : m_Partitions)
+	{
+		FTAEventStore* Partition = Pair.Value;
+		if ( Partition->m_AckedSeqs.Num() > 0 )
+		{
+			TArray<FString> Paths;
+			for (uint64 Seq : Partition->m_AckedSeqs)
+			{
+				Paths.Add(Partition->GetBatchPath(Seq));
+			}
+			Partition->m_AckedSeqs.Reset();
+			m_Writer->Enqueue([Paths]()
+			{
+				IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+				for (const FString& Path : Paths)
+				{
+					PlatformFile.DeleteFile(*Path);
+				}
+			});
+		}
+	}
+	TrimLog(true);
+	if ( m_CursorDirty )
+	{
+		// consumed events without a commit since, e.g. debug deliveries
+		WriteCursor();
+	}
+}
+
+FTAEventStore::FTAEventStore(FTAStorageEngine* Engine, const FString& AppID, uint64 AckSeq)
+{
+	m_Engine = Engine;
+	m_AppID = AppID;
+	m_Directory = Engine->m_Directory / AppID;
+	m_LogConsumed = 0;
+	m_LogCommitted = 0;
+	m_PendingNum = 0;
+	m_BatchEventNum = 0;
+	m_BatchBytes = 0;
+	m_MaxBytes = 0;
+	m_MaxAgeSeconds = 0;
+	m_PriorityFirst = false;
+	m_EvictedNum = 0;
+	m_DroppedNum = 0;
+	m_AckSeq = AckSeq;
+}
+
+FString FTAEventStore::GetBatchPath(uint64 Seq)
+{
+	return m_Directory / FString::Printf(TEXT("%020llu.%s"), Seq, BATCH_EXTENSION);
+}
+
+FString FTAEventStore::GetMetaPath(const FString& Name)
+{
+	return m_Directory / FString::Printf(TEXT("%s.%s"), *Name, META_EXTENSION);
+}
+
+uint64 FTAEventStore::Recover()
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.CreateDirectoryTree(*m_Directory);
+
+	TArray<FString> FileNames;
+	IFileManager::Get().FindFiles(FileNames, *(m_Directory / TEXT("*")), true, false);
+
+	uint64 MaxSeq = 0;
+	TArray<uint64> BatchSeqs;
+	for (const FString& FileName : FileNames)
+	{
+		FString Extension = FPaths::GetExtension(FileName);
+		uint64 Seq = FCString::Strtoui64(*FPaths::GetBaseFilename(FileName), nullptr, 10);
+		if ( Extension == META_EXTENSION )
+		{
+			continue;
+		}
+		else if ( Extension == BATCH_EXTENSION && Seq > 0 )
+		{
+			BatchSeqs.Add(Seq);
+			MaxSeq = FMath::Max(MaxSeq, Seq);
+		}
+		else
+		{
+			// interrupted atomic writes
+			PlatformFile.DeleteFile(*(m_Directory / FileName));
+		}
+	}
+	BatchSeqs.Sort();
+
+	uint32 LostBatchNum = 0;
+	for (uint64 Seq : BatchSeqs)
+	{
+		FBatchInfo Info;
+		uint64 SourceSeq = 0;
+		uint64 SourceOffset = 0;
+		if ( Seq < m_AckSeq )
+		{
+			// acknowledged before the last compaction ran
+			PlatformFile.DeleteFile(*GetBatchPath(Seq));
+		}
+		else if ( ReadBatchInfo(Seq, Info, SourceSeq, SourceOffset) )
+		{
+			m_Batches.Add(Info);
+			m_BatchEventNum += Info.EventNum;
+			m_BatchBytes += Info.Size;
+			uint64& SealedOffset = m_SealedOffsets.FindOrAdd(SourceSeq);
+			SealedOffset = FMath::Max(SealedOffset, SourceOffset);
+		}
+		else
+		{
+			LostBatchNum++;
+			PlatformFile.DeleteFile(*GetBatchPath(Seq));
+		}
+	}
+
+	if ( LostBatchNum > 0 )
+	{
+		FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Event store of %s lost %d batches"), *m_AppID, LostBatchNum));
+	}
+	return MaxSeq;
+}
+
+void FTAEventStore::ApplyRecoveredOffset(uint64 SkipOffset)
+{
+	int32 Offset = 0;
+	m_LogConsumed = 0;
+	m_PendingNum = 0;
+	FTAEventRecordView Record;
+	while ( FTAEventRecord::Decode(m_LogRecords.GetData() + Offset, m_LogRecords.Num() - Offset, Record) == ETARecordStatus::Valid )
+	{
+		Offset += Record.RecordSize;
+		if ( Offset <= (int64)SkipOffset )
+		{
+			// already sealed into a batch or acknowledged
+			m_LogConsumed = Offset;
+		}
+		else
+		{
+			m_PendingNum++;
+		}
+	}
+	m_LogRecords.SetNum(Offset, false);
+	m_LogCommitted = m_LogRecords.Num();
+	m_SealedOffsets.Empty();
+	m_RecordTimes.Reset();
+	if ( m_PendingNum > 0 )
+	{
+		m_RecordTimes.Add({ m_LogConsumed, m_Engine->m_LogCreateTime });
+	}
+}
+
+uint32 FTAEventStore::ImportRecords(const TArray<uint8>& Records, uint64 SkipOffset, int64 CreateTime)
+{
+	// older than the pending records of this run, still they go behind them: the log only grows at its tail
+	int32 StartOffset = m_LogRecords.Num();
+	uint32 ImportedNum = 0;
+	int32 Offset = 0;
+	FTAEventRecordView Record;
+	while ( FTAEventRecord::Decode(Records.GetData() + Offset, Records.Num() - Offset, Record) == ETARecordStatus::Valid )
+	{
+		if ( Offset + Record.RecordSize > (int64)SkipOffset )
+		{
+			m_LogRecords.Append(Records.GetData() + Offset, Record.RecordSize);
+			m_PendingNum++;
+			ImportedNum++;
+		}
+		Offset += Record.RecordSize;
+	}
+	if ( ImportedNum > 0 )
+	{
+		m_RecordTimes.Add({ StartOffset, CreateTime > 0 ? CreateTime : FDateTime::UtcNow().ToUnixTimestamp() });
+	}
+	return ImportedNum;
+}
+
+bool FTAEventStore::ReadBatchInfo(uint64 Seq, FBatchInfo& OutInfo, uint64& OutSourceSeq, uint64& OutSourceOffset)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	IFileHandle* Handle = PlatformFile.OpenRead(*GetBatchPath(Seq));
+	if ( !Handle )
+	{
+		return false;
+	}
+
+	// header only, the payload crc is checked when the batch is read for upload
+	uint8 Header[FILE_HEADER_SIZE + FTAEventRecord::HEADER_SIZE + 4];
+	int64 FileSize = Handle->Size();
+	bool Result = Handle->Read(Header, sizeof(Header));
+	delete Handle;
+	if ( !Result || !IsValidFileHeader(Header, sizeof(Header), FILE_KIND_BATCH) )
+	{
+		return false;
+	}
+
+	uint32 PayloadSize = FTAEventRecord::ReadUInt32(Header + FILE_HEADER_SIZE);
+	if ( FileSize != FILE_HEADER_SIZE + FTAEventRecord::HEADER_SIZE + (int64)PayloadSize || PayloadSize < 4 )
+	{
+		return false;
+	}
+
+	OutInfo.Seq = Seq;
+	OutInfo.EventNum = FTAEventRecord::ReadUInt32(Header + FILE_HEADER_SIZE + FTAEventRecord::HEADER_SIZE);
+	OutInfo.Size = FileSize;
+	OutInfo.CreateTime = (int64)ReadUInt64(Header + 8);
+	OutInfo.Priority = Header[6];
+	OutSourceSeq = ReadUInt64(Header + 16);
+	OutSourceOffset = ReadUInt64(Header + 24);
+	return true;
+}
+
+void FTAEventStore::AddEvent(const FString& EventJson)
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	int64 Now = FDateTime::UtcNow().ToUnixTimestamp();
+	if ( m_RecordTimes.Num() == 0 || m_RecordTimes.Last().Time != Now )
+	{
+		m_RecordTimes.Add({ m_LogRecords.Num(), Now });
+	}
+	FTAEventRecord::Append(m_LogRecords, EventJson);
+	m_PendingNum++;
+}
+
+bool FTAEventStore::Commit()
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	return m_Engine->Commit();
+}
+
+bool FTAEventStore::Sync()
+{
+	return m_Engine->Sync();
+}
+
+void FTAEventStore::SyncAsync(TFunction<void(bool)>&& OnSynced)
+{
+	m_Engine->SyncAsync(MoveTemp(OnSynced));
+}
+
+uint32 FTAEventStore::Num()
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	return m_PendingNum + m_BatchEventNum;
+}
+
+uint32 FTAEventStore::PendingNum()
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	return m_PendingNum;
+}
+
+int64 FTAEventStore::Bytes()
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	return m_BatchBytes + m_LogRecords.Num() - m_LogConsumed;
+}
+
+void FTAEventStore::GetEventJsons(uint32 Skip, uint32 Count, TArray<FString>& OutEvents)
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	uint32 Index = 0;
+	int32 Offset = m_LogConsumed;
+	FTAEventRecordView Record;
+	while ( Index < Skip + Count && FTAEventRecord::Decode(m_LogRecords.GetData() + Offset, m_LogRecords.Num() - Offset, Record) == ETARecordStatus::Valid )
+	{
+		if ( Index >= Skip )
+		{
+			OutEvents.Add(Record.ToString());
+		}
+		Offset += Record.RecordSize;
+		Index++;
+	}
+}
+
+uint32 FTAEventStore::GetEventPayloads(uint32 Count, TArray<uint8>& OutBody)
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	uint32 EventNum = 0;
+	int32 Offset = m_LogConsumed;
+	FTAEventRecordView Record;
+	while ( EventNum < Count && FTAEventRecord::Decode(m_LogRecords.GetData() + Offset, m_LogRecords.Num() - Offset, Record) == ETARecordStatus::Valid )
+	{
+		if ( EventNum > 0 )
+		{
+			OutBody.Add(',');
+		}
+		OutBody.Append(Record.Payload, Record.PayloadSize);
+		Offset += Record.RecordSize;
+		EventNum++;
+	}
+	return EventNum;
+}
+
+void FTAEventStore::RemoveEvents(uint32 Count)
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	FTAEventRecordView Record;
+	while ( Count > 0 && FTAEventRecord::Decode(m_LogRecords.GetData() + m_LogConsumed, m_LogRecords.Num() - m_LogConsumed, Record) == ETARecordStatus::Valid )
+	{
+		m_LogConsumed += Record.RecordSize;
+		m_PendingNum--;
+		Count--;
+	}
+
+	// only the read cursor moves, the next group commit or Compact() writes it and trims the log
+	m_Engine->m_CursorDirty = true;
+	m_Engine->TrimLog(false);
+}
+
+void FTAEventStore::WriteBatchFile(uint64 Seq, const TArray<uint8>& CompressedBody, uint32 EventNum, uint8 Priority, uint64 SourceSeq, uint64 SourceOffset)
+{
+	FBatchInfo Info;
+	Info.Seq = Seq;
+	Info.EventNum = EventNum;
+	Info.Size = FILE_HEADER_SIZE + FTAEventRecord::HEADER_SIZE + 4 + CompressedBody.Num();
+	Info.CreateTime = FDateTime::UtcNow().ToUnixTimestamp();
+	Info.Priority = Priority;
+	Info.Body = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>(CompressedBody);
+	m_Batches.Add(Info);
+	m_BatchEventNum += EventNum;
+	m_BatchBytes += Info.Size;
+
+	// the body stays in memory only until the file is written
+	TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> Body = Info.Body;
+	FString Path = GetBatchPath(Seq);
+	FTAStorageEngine* Engine = m_Engine;
+	m_Engine->m_Writer->Enqueue([this, Engine, Seq, Path, EventNum, Priority, SourceSeq, SourceOffset, Body]()
+	{
+		TArray<uint8> Payload;
+		Payload.AddUninitialized(4);
+		FTAEventRecord::WriteUInt32(Payload.GetData(), EventNum);
+		Payload.Append(*Body);
+
+		TArray<uint8> Data;
+		WriteFileHeader(Data, FILE_KIND_BATCH, Priority, SourceSeq, SourceOffset);
+		FTAEventRecord::Append(Data, Payload.GetData(), Payload.Num(), (uint8)ETARecordType::GzipBatch);
+		if ( !WriteFileAtomic(Path, Data) )
+		{
+			Engine->m_WriteFailed = true;
+			FTALog::Warning(CUR_LOG_POSITION, TEXT("Write event batch failed, kept in memory only !"));
+			return;
+		}
+
+		//lock
+		FScopeLock EngineLock(&Engine->m_Critical);
+		for (FBatchInfo& Batch : m_Batches)
+		{
+			if ( Batch.Seq == Seq )
+			{
+				Batch.Body.Reset();
+				break;
+			}
+		}
+	});
+}
+
+bool FTAEventStore::SealBatch(const TArray<uint8>& CompressedBody, uint32 EventNum, uint8 Priority)
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	int32 SealedOffset = m_LogConsumed;
+	uint32 SealedNum = 0;
+	FTAEventRecordView Record;
+	while ( SealedNum < EventNum && FTAEventRecord::Decode(m_LogRecords.GetData() + SealedOffset, m_LogRecords.Num() - SealedOffset, Record) == ETARecordStatus::Valid )
+	{
+		SealedOffset += Record.RecordSize;
+		SealedNum++;
+	}
+
+	WriteBatchFile(m_Engine->m_NextSeq++, CompressedBody, SealedNum, Priority, m_Engine->m_LogSeq, SealedOffset);
+	m_LogConsumed = SealedOffset;
+	m_PendingNum -= SealedNum;
+	m_Engine->m_CursorDirty = true;
+	m_Engine->TrimLog(false);
+	EnforceLimits();
+	return true;
+}
+
+bool FTAEventStore::PeekBatch(TArray<uint8>& OutCompressedBody, uint32& OutEventNum, uint64& OutSeq, const TArray<uint64>& SkipSeqs)
+{
+	while ( true )
+	{
+		uint64 Seq = 0;
+		{
+			//lock
+			FScopeLock EngineLock(&m_Engine->m_Critical);
+			int32 Index = 0;
+			while ( Index < m_Batches.Num() && SkipSeqs.Contains(m_Batches[Index].Seq) )
+			{
+				Index++;
+			}
+			if ( Index == m_Batches.Num() )
+			{
+				return false;
+			}
+			const FBatchInfo& Info = m_Batches[Index];
+			if ( Info.Body.IsValid() )
+			{
+				OutSeq = Info.Seq;
+				OutEventNum = Info.EventNum;
+				OutCompressedBody = *Info.Body;
+				return true;
+			}
+			Seq = Info.Seq;
+		}
+
+		// the file is read without the engine lock, the other partitions keep going. the body is not kept
+		uint32 EventNum = 0;
+		bool Result = ReadBatchBody(Seq, OutCompressedBody, EventNum);
+
+		//lock
+		FScopeLock EngineLock(&m_Engine->m_Critical);
+		int32 Index = m_Batches.IndexOfByPredicate([Seq](const FBatchInfo& Info) { return Info.Seq == Seq; });
+		if ( Index == INDEX_NONE )
+		{
+			// evicted meanwhile, take the next one
+			continue;
+		}
+		if ( Result )
+		{
+			OutSeq = Seq;
+			OutEventNum = EventNum;
+			return true;
+		}
+
+		FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Drop corrupted event batch, lost %d events"), m_Batches[Index].EventNum));
+		DeleteBatchAt(Index);
+	}
+}
+
+bool FTAEventStore::ReadBatchBody(uint64 Seq, TArray<uint8>& OutCompressedBody, uint32& OutEventNum)
+{
+	TArray<uint8> Data;
+	FTAEventRecordView Record;
+	if ( !FFileHelper::LoadFileToArray(Data, *GetBatchPath(Seq))
+		|| !IsValidFileHeader(Data.GetData(), Data.Num(), FILE_KIND_BATCH)
+		|| FTAEventRecord::Decode(Data.GetData() + FILE_HEADER_SIZE, Data.Num() - FILE_HEADER_SIZE, Record) != ETARecordStatus::Valid
+		|| Record.PayloadSize < 4 )
+	{
+		return false;
+	}
+	OutEventNum = FTAEventRecord::ReadUInt32(Record.Payload);
+	OutCompressedBody.Reset(Record.PayloadSize - 4);
+	OutCompressedBody.Append(Record.Payload + 4, Record.PayloadSize - 4);
+	return true;
+}
+
+void FTAEventStore::RemoveBatch(uint64 Seq)
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	int32 Index = m_Batches.IndexOfByPredicate([Seq](const FBatchInfo& Info) { return Info.Seq == Seq; });
+	if ( Index == INDEX_NONE )
+	{
+		return;
+	}
+
+	// acknowledge by moving the cursor, the file is deleted by Compact(). the cursor only covers the oldest batch,
+	// a batch acknowledged out of order is deleted right away so a restart does not send it again
+	const FBatchInfo& Info = m_Batches[Index];
+	if ( Index == 0 )
+	{
+		m_AckedSeqs.Add(Info.Seq);
+	}
+	else
+	{
+		FString Path = GetBatchPath(Info.Seq);
+		m_Engine->m_Writer->Enqueue([Path]()
+		{
+			FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*Path);
+		});
+	}
+	m_BatchEventNum -= FMath::Min(m_BatchEventNum, Info.EventNum);
+	m_BatchBytes -= Info.Size;
+	m_Batches.RemoveAt(Index);
+	m_AckSeq = m_Batches.Num() > 0 ? m_Batches[0].Seq : m_Engine->m_NextSeq;
+
+	// no write per ack, the next group commit or Compact() writes the cursor. a crash before that sends the batch again
+	m_Engine->m_CursorDirty = true;
+}
+
+void FTAEventStore::Compact()
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	m_Engine->Compact();
+	// only this partition: the head of another one may be read by its own handle right now
+	EnforceLimits();
+}
+
+void FTAEventStore::DeleteBatchAt(int32 Index)
+{
+	const FBatchInfo& Info = m_Batches[Index];
+	FString Path = GetBatchPath(Info.Seq);
+	m_Engine->m_Writer->Enqueue([Path]()
+	{
+		FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*Path);
+	});
+	m_BatchEventNum -= FMath::Min(m_BatchEventNum, Info.EventNum);
+	m_BatchBytes -= Info.Size;
+	m_Batches.RemoveAt(Index);
+}
+
+uint32 FTAEventStore::BatchNum()
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	return m_Batches.Num();
+}
+
+void FTAEventStore::SetLimits(int64 MaxBytes, int64 MaxAgeSeconds, bool PriorityFirst)
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	m_MaxBytes = MaxBytes;
+	m_MaxAgeSeconds = MaxAgeSeconds;
+	m_PriorityFirst = PriorityFirst;
+	EnforceLimits();
+}
+
+uint32 FTAEventStore::GetEvictedNum()
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	return m_EvictedNum;
+}
+
+uint32 FTAEventStore::TakeDroppedNum()
+{
+	//lock
+	FScopeLock EngineLock(&m_Engine->m_Critical);
+	uint32 DroppedNum = m_DroppedNum;
+	m_DroppedNum = 0;
+	return DroppedNum;
+}
+
+bool FTAEventStore::ReadMeta(const FString& Name, TArray<uint8>& OutData)
+{
+	return FFileHelper::LoadFileToArray(OutData, *GetMetaPath(Name), FILEREAD_Silent);
+}
+
+void FTAEventStore::WriteMeta(const FString& Name, const TArray<uint8>& Data)
+{
+	FString Path = GetMetaPath(Name);
+	m_Engine->m_Writer->Enqueue([Path, Data]()
+	{
+		if ( !WriteFileAtomic(Path, Data) )
+		{
+			FTALog::Warning(CUR_LOG_POSITION, TEXT("Write event store meta failed !"));
+		}
+	});
+}
+
+void FTAEventStore::DeleteMeta(const FString& Name)
+{
+	FString Path = GetMetaPath(Name);
+	m_Engine->m_Writer->Enqueue([Path]()
+	{
+		FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*Path);
+	});
+}
+
+void FTAEventStore::EnforceLimits()
+{
+	uint32 ExpiredNum = 0;
+	uint32 EvictedNum = 0;
+
+	uint32 DroppedNum = 0;
+
+	if ( m_MaxAgeSeconds > 0 )
+	{
+		int64 ExpireTime = FDateTime::UtcNow().ToUnixTimestamp() - m_MaxAgeSeconds;
+		for (int32 i = m_Batches.Num() - 1; i >= 0; i--)
+		{
+			if ( m_Batches[i].CreateTime < ExpireTime )
+			{
+				ExpiredNum += m_Batches[i].EventNum;
+				DeleteBatchAt(i);
+			}
+		}
+
+		// pending records, oldest first. nothing is sealed in DEBUG, an unreachable receiver leaves them all here
+		TrimRecordTimes();
+		while ( m_RecordTimes.Num() > 0 && m_RecordTimes[0].Time < ExpireTime )
+		{
+			int32 EndOffset = m_RecordTimes.Num() > 1 ? m_RecordTimes[1].Offset : m_LogRecords.Num();
+			DroppedNum += DropPending(EndOffset);
+			m_RecordTimes.RemoveAt(0);
+		}
+		ExpiredNum += DroppedNum;
+	}
+
+	if ( m_MaxBytes > 0 )
+	{
+		while ( m_Batches.Num() > 0 && m_BatchBytes + m_LogRecords.Num() - m_LogConsumed > m_MaxBytes )
+		{
+			// batches are ordered oldest first
+			int32 Victim = 0;
+			if ( m_PriorityFirst )
+			{
+				for (int32 i = 1; i < m_Batches.Num(); i++)
+				{
+					if ( m_Batches[i].Priority < m_Batches[Victim].Priority )
+					{
+						Victim = i;
+					}
+				}
+			}
+			EvictedNum += m_Batches[Victim].EventNum;
+			DeleteBatchAt(Victim);
+		}
+
+		// still over the limit with every batch gone: the oldest pending records
+		uint32 OverSizeNum = 0;
+		while ( m_PendingNum > 0 && m_BatchBytes + m_LogRecords.Num() - m_LogConsumed > m_MaxBytes )
+		{
+			uint32 Num = DropPending(m_LogConsumed + 1);
+			if ( Num == 0 )
+			{
+				break;
+			}
+			OverSizeNum += Num;
+		}
+		EvictedNum += OverSizeNum;
+		DroppedNum += OverSizeNum;
+	}
+
+	if ( DroppedNum > 0 )
+	{
+		// like a consumption: the cursor moves with the next commit or compaction
+		m_Engine->m_CursorDirty = true;
+		m_Engine->TrimLog(false);
+	}
+
+	if ( ExpiredNum > 0 || EvictedNum > 0 )
+	{
+		m_EvictedNum += ExpiredNum + EvictedNum;
+		FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Event cache of %s dropped %d expired and %d over-size events, %d in total"), *m_AppID, ExpiredNum, EvictedNum, m_EvictedNum));
+	}
+}
+
+uint32 FTAEventStore::DropPending(int32 EndOffset)
+{
+	uint32 DroppedNum = 0;
+	FTAEventRecordView Record;
+	while ( m_LogConsumed < EndOffset && FTAEventRecord::Decode(m_LogRecords.GetData() + m_LogConsumed, m_LogRecords.Num() - m_LogConsumed, Record) == ETARecordStatus::Valid )
+	{
+		m_LogConsumed += Record.RecordSize;
+		m_PendingNum--;
+		DroppedNum++;
+	}
+	m_DroppedNum += DroppedNum;
+	return DroppedNum;
+}
+
+void FTAEventStore::TrimRecordTimes()
+{
+	int32 ConsumedNum = 0;
+	while ( ConsumedNum < m_RecordTimes.Num() && (ConsumedNum + 1 < m_RecordTimes.Num() ? m_RecordTimes[ConsumedNum + 1].Offset : m_LogRecords.Num()) <= m_LogConsumed )
+	{
+		ConsumedNum++;
+	}
+	if ( ConsumedNum > 0 )
+	{
+		m_RecordTimes.RemoveAt(0, ConsumedNum, false);
+	}
+}
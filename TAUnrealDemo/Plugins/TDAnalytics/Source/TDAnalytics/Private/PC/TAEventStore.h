@@ -0,0 +1,338 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TAEventRecord.h"
+#include "HAL/ThreadSafeBool.h"
+
+class IFileHandle;
+
+class FTAFileWriter;
+
+class FTAStorageEngine;
+
+/**
+ * Event cache partition of one app id, owned by the shared FTAStorageEngine.
+ *
+ * Pending events live in the shared log, sealed upload batches in the partition directory
+ * Saved/TDAnalytics/<AppID>/ (*.tdbatch), written through a temp file and a rename so a batch is either
+ * complete or absent. Size and age limits are enforced per partition on sealing and on Compact(): whole batch
+ * segments go first, then pending events from the head of the log.
+ *
+ * Every call locks the engine, a partition may be used from its task handle and from http callbacks.
+ */
+class FTAEventStore
+{
+public:
+
+	const static int32 FILE_HEADER_SIZE = 32;
+
+	void AddEvent(const FString& EventJson);
+
+	// group commit of every partition with pending records
+	bool Commit();
+
+	// waits for every queued write, false if one of them failed
+	bool Sync();
+
+	// calls OnSynced on the I/O thread once every write queued so far has run, with false if one of them failed.
+	// does not block, for callers that must not hold up a task graph worker
+	void SyncAsync(TFunction<void(bool)>&& OnSynced);
+
+	uint32 Num();
+
+	uint32 PendingNum();
+
+	// bytes of every cached event, sealed or not
+	int64 Bytes();
+
+	// stored json of up to Count pending events after the first Skip ones
+	void GetEventJsons(uint32 Skip, uint32 Count, TArray<FString>& OutEvents);
+
+	// appends the stored json of up to Count pending events to OutBody as is, separated by commas. returns the number appended
+	uint32 GetEventPayloads(uint32 Count, TArray<uint8>& OutBody);
+
+	void RemoveEvents(uint32 Count);
+
+	bool SealBatch(const TArray<uint8>& CompressedBody, uint32 EventNum, uint8 Priority);
+
+	// oldest batch that is not in SkipSeqs, i.e. not already in flight
+	bool PeekBatch(TArray<uint8>& OutCompressedBody, uint32& OutEventNum, uint64& OutSeq, const TArray<uint64>& SkipSeqs);
+
+	void RemoveBatch(uint64 Seq);
+
+	uint32 BatchNum();
+
+	// MaxBytes / MaxAgeSeconds of 0 disable the limit. batches with a higher priority are evicted last when PriorityFirst is set
+	void SetLimits(int64 MaxBytes, int64 MaxAgeSeconds, bool PriorityFirst);
+
+	uint32 GetEvictedNum();
+
+	// pending events dropped from the head by the limits since the last call, a reader of the head skips as many
+	uint32 TakeDroppedNum();
+
+	// reclaims acknowledged batches and the consumed log, then enforces the limits of this partition
+	void Compact();
+
+	// small named state files (*.tdmeta) next to the batches, written atomically in queue order
+	bool ReadMeta(const FString& Name, TArray<uint8>& OutData);
+
+	void WriteMeta(const FString& Name, const TArray<uint8>& Data);
+
+	void DeleteMeta(const FString& Name);
+
+private:
+
+	friend class FTAStorageEngine;
+
+	struct FBatchInfo
+	{
+		uint64 Seq;
+
+		uint32 EventNum;
+
+		int64 Size;
+
+		int64 CreateTime;
+
+		uint8 Priority;
+
+		// compressed body until the batch file is written, later reads go to the file
+		TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> Body;
+	};
+
+	// records of m_LogRecords from Offset on were added at Time or later, one entry per second with new records
+	struct FRecordTime
+	{
+		int32 Offset;
+
+		int64 Time;
+	};
+
+	FTAEventStore(FTAStorageEngine* Engine, const FString& AppID, uint64 AckSeq);
+
+	FTAStorageEngine* m_Engine;
+
+	FString m_AppID;
+
+	FString m_Directory;
+
+	// records of this app id in the current shared log segment, m_LogConsumed bytes at the front are sealed or sent
+	TArray<uint8> m_LogRecords;
+
+	int32 m_LogConsumed;
+
+	int32 m_LogCommitted;
+
+	uint32 m_PendingNum;
+
+	TArray<FBatchInfo> m_Batches;
+
+	uint32 m_BatchEventNum;
+
+	int64 m_BatchBytes;
+
+	int64 m_MaxBytes;
+
+	int64 m_MaxAgeSeconds;
+
+	bool m_PriorityFirst;
+
+	uint32 m_EvictedNum;
+
+	// ascending offsets. recovered records carry the create time of their log
+	TArray<FRecordTime> m_RecordTimes;
+
+	uint32 m_DroppedNum;
+
+	// batches below m_AckSeq are acknowledged
+	uint64 m_AckSeq;
+
+	TArray<uint64> m_AckedSeqs;
+
+	// highest consumed offset of each log segment, from the batch headers
+	TMap<uint64, uint64> m_SealedOffsets;
+
+	uint64 Recover();
+
+	void ApplyRecoveredOffset(uint64 SkipOffset);
+
+	// appends the records of a held log behind the pending ones, returns the number appended
+	uint32 ImportRecords(const TArray<uint8>& Records, uint64 SkipOffset, int64 CreateTime);
+
+	void EnforceLimits();
+
+	// drops the pending records before EndOffset, at least one. returns the number dropped
+	uint32 DropPending(int32 EndOffset);
+
+	// forgets the times of consumed records
+	void TrimRecordTimes();
+
+	void DeleteBatchAt(int32 Index);
+
+	bool ReadBatchInfo(uint64 Seq, FBatchInfo& OutInfo, uint64& OutSourceSeq, uint64& OutSourceOffset);
+
+	// reads and checks the whole batch file, called without the engine lock
+	bool ReadBatchBody(uint64 Seq, TArray<uint8>& OutCompressedBody, uint32& OutEventNum);
+
+	void WriteBatchFile(uint64 Seq, const TArray<uint8>& CompressedBody, uint32 EventNum, uint8 Priority, uint64 SourceSeq, uint64 SourceOffset);
+
+	FString GetBatchPath(uint64 Seq);
+
+	FString GetMetaPath(const FString& Name);
+};
+
+/**
+ * Storage shared by every app id, kept under Saved/TDAnalytics/.
+ *
+ * All partitions append to one log segment (*.tdlog) through one group commit: each commit writes one
+ * PartitionRecords record per partition with new events, then flushes once. Every segment starts with a
+ * FILE_HEADER_SIZE header:
+ * | "TDAS" | uint8 version | uint8 kind | uint8 priority | 1 reserved | uint64 create time | uint64 source log seq | uint64 source log offset |
+ * The source fields of a batch tell recovery which records of its partition it already contains.
+ *
+ * Progress is kept in one cursor (two cursor*.tdcursor slots written alternately): the live log and, per
+ * partition, how far its records are consumed and the oldest unacknowledged batch. Consuming events or
+ * acknowledging a batch only moves the cursor, Compact() deletes acknowledged batches and trims the log later.
+ *
+ * A log that exists but cannot be read at startup, e.g. under a sharing lock, is held instead of dropped: a
+ * *.tdhold marker keeps its consumed offsets, new events go to a fresh segment and Compact() retries the read.
+ * Once read, its unconsumed records move into the live log and the held log goes.
+ *
+ * Every file write, rename and delete is handed to one FTAFileWriter in order, so callers never wait on the
+ * disk and the number of open files and flushes does not grow with the number of app ids.
+ */
+class FTAStorageEngine
+{
+public:
+
+	static FTAStorageEngine& Get();
+
+	// Get() is the engine of the SDK, other instances on a scratch directory are for the automation tests
+	explicit FTAStorageEngine(const FString& Directory);
+
+	// UseTaskGraph overrides the execution mode of the settings for the I/O
+	FTAStorageEngine(const FString& Directory, bool UseTaskGraph);
+
+	~FTAStorageEngine();
+
+	FTAEventStore* OpenPartition(const FString& AppID);
+
+	// commits every partition, waits for the disk and joins the I/O thread. later writes run on the caller
+	void Shutdown();
+
+private:
+
+	friend class FTAEventStore;
+
+	struct FCursorEntry
+	{
+		uint64 AckSeq;
+
+		uint64 Consumed;
+	};
+
+	enum class ELogRecovery : uint8
+	{
+		Intact,
+		// invalid header or records, the intact prefix is kept
+		Torn,
+		// open or read failed, nothing is known about the records
+		Unreadable
+	};
+
+	FCriticalSection m_Critical;
+
+	FString m_Directory;
+
+	FTAFileWriter* m_Writer;
+
+	TMap<FString, FTAEventStore*> m_Partitions;
+
+	uint64 m_NextSeq;
+
+	uint64 m_LogSeq;
+
+	bool m_NeedRewrite;
+
+	FThreadSafeBool m_WriteFailed;
+
+	uint64 m_CursorGeneration;
+
+	bool m_CursorDirty;
+
+	TMap<FString, FCursorEntry> m_RecoveredCursor;
+
+	double m_LastCompactTime;
+
+	// create time in the header of the recovered live log
+	int64 m_LogCreateTime;
+
+	// logs that could not be read yet and the offset of the first unconsumed record of each app id in them
+	TMap<uint64, TMap<FString, uint64>> m_HeldLogs;
+
+	// held logs already moved into the live log, deleted with the old log of the next rewrite or rotation
+	TArray<uint64> m_ImportedLogSeqs;
+
+	// owned by the I/O thread
+	IFileHandle* m_LogHandle;
+
+	uint64 m_LogHandleSeq;
+
+	uint64 m_FailedLogSeq;
+
+	void Recover();
+
+	FTAEventStore* FindOrAddPartition(const FString& AppID);
+
+	ELogRecovery RecoverLog(uint64 Seq, uint32& OutLostNum);
+
+	// records of every app id in a log, false if it is torn
+	static bool ReadLogRecords(const TArray<uint8>& Data, TMap<FString, TArray<uint8>>& OutRecords, uint32& OutLostNum);
+
+	// writes the *.tdhold marker of a log that could not be read, recovery only
+	void HoldLog(uint64 Seq, const TMap<FString, uint64>& SkipOffsets);
+
+	bool ReadHoldMarker(uint64 Seq, TMap<FString, uint64>& OutSkipOffsets);
+
+	// moves the unconsumed records of every held log that can be read now into the partitions, true if one was
+	bool ImportHeldLogs();
+
+	// deletes the imported held logs and their markers once a new log holds their records, runs on the I/O thread
+	void DeleteImportedLogs(const TArray<uint64>& Seqs);
+
+	bool ReadCursor(uint64& OutLogSeq);
+
+	bool Commit();
+
+	bool Sync();
+
+	void SyncAsync(TFunction<void(bool)>&& OnSynced);
+
+	void Compact();
+
+	// rotates or rewrites the log once partitions consumed enough of it
+	void TrimLog(bool Force);
+
+	void RewriteLog();
+
+	void RotateLog();
+
+	void WriteCursor();
+
+	int32 BuildCursor(TArray<uint8>& OutData);
+
+	void WriteCursorFile(int32 Slot, const TArray<uint8>& Data);
+
+	void AppendLogFile(uint64 Seq, const TArray<uint8>& Records);
+
+	void CloseLog();
+
+	static void AppendPartitionRecords(TArray<uint8>& Buffer, const FString& AppID, const uint8* Records, int32 Size);
+
+	FString GetLogPath(uint64 Seq);
+
+	FString GetCursorPath(int32 Slot);
+
+	FString GetHoldPath(uint64 Seq);
+};
@@ -0,0 +1,144 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#include "TAFileWriter.h"
+
+#include "HAL/RunnableThread.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "Async/TaskGraphInterfaces.h"
+
+FTAFileWriter::FTAFileWriter(const FString& ThreadName, bool UseTaskGraph)
+{
+	m_WakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	m_UseTaskGraph = UseTaskGraph;
+	m_Draining = false;
+	m_Thread = UseTaskGraph ? nullptr : FRunnableThread::Create(this, *ThreadName, 128 * 1024, TPri_BelowNormal);
+}
+
+FTAFileWriter::~FTAFileWriter()
+{
+	Shutdown();
+	FPlatformProcess::ReturnSynchEventToPool(m_WakeEvent);
+	m_WakeEvent = nullptr;
+}
+
+void FTAFileWriter::Shutdown()
+{
+	Stop();
+	if ( m_Thread )
+	{
+		m_Thread->WaitForCompletion();
+		delete m_Thread;
+		m_Thread = nullptr;
+	}
+	else if ( m_UseTaskGraph )
+	{
+		Flush();
+		m_UseTaskGraph = false;
+	}
+	else
+	{
+		// no thread support, run what is left inline
+		TFunction<void()> Task;
+		while ( m_Tasks.Dequeue(Task) )
+		{
+			Task();
+		}
+	}
+}
+
+uint32 FTAFileWriter::Run()
+{
+	while ( true )
+	{
+		TFunction<void()> Task;
+		while ( m_Tasks.Dequeue(Task) )
+		{
+			Task();
+			m_PendingNum.Decrement();
+		}
+		if ( m_Stopping )
+		{
+			if ( m_Tasks.IsEmpty() )
+			{
+				break;
+			}
+			continue;
+		}
+		m_WakeEvent->Wait();
+	}
+	return 0;
+}
+
+void FTAFileWriter::Stop()
+{
+	m_Stopping = true;
+	m_WakeEvent->Trigger();
+}
+
+void FTAFileWriter::Enqueue(TFunction<void()>&& Task)
+{
+	if ( !m_Thread && !m_UseTaskGraph )
+	{
+		Task();
+		return;
+	}
+	m_PendingNum.Increment();
+	m_Tasks.Enqueue(MoveTemp(Task));
+	if ( m_UseTaskGraph )
+	{
+		DispatchDrain();
+	}
+	else
+	{
+		m_WakeEvent->Trigger();
+	}
+}
+
+void FTAFileWriter::DispatchDrain()
+{
+	// one job at a time keeps the queue order
+	bool Expected = false;
+	if ( m_Draining.compare_exchange_strong(Expected, true) )
+	{
+		FFunctionGraphTask::CreateAndDispatchWhenReady([this]()
+		{
+			Drain();
+		}, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+	}
+}
+
+void FTAFileWriter::Drain()
+{
+	TFunction<void()> Task;
+	while ( m_Tasks.Dequeue(Task) )
+	{
+		Task();
+		m_PendingNum.Decrement();
+	}
+	m_Draining = false;
+	if ( !m_Tasks.IsEmpty() )
+	{
+		// queued after the last dequeue but before the reset
+		DispatchDrain();
+	}
+}
+
+void FTAFileWriter::Flush()
+{
+	while ( (m_Thread || m_UseTaskGraph) && m_PendingNum.GetValue() > 0 )
+	{
+		bool Expected = false;
+		if ( m_UseTaskGraph && m_Draining.compare_exchange_strong(Expected, true) )
+		{
+			// no job is draining, do not wait for a free background thread
+			Drain();
+			continue;
+		}
+		FPlatformProcess::Sleep(0.001f);
+	}
+}
+
+int32 FTAFileWriter::PendingNum()
+{
+	return m_PendingNum.GetValue();
+}
@@ -0,0 +1,62 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "Containers/Queue.h"
+
+#include <atomic>
+
+class FRunnableThread;
+
+/**
+ * Dedicated I/O thread running file tasks in the order they were queued.
+ * Callers only pay for the enqueue, a slow disk no longer blocks the task handle.
+ * With UseTaskGraph no thread is created, the queue is drained by one background task graph job at a time.
+ */
+class FTAFileWriter : public FRunnable
+{
+public:
+
+	FTAFileWriter(const FString& ThreadName, bool UseTaskGraph = false);
+
+	// runs every queued task before the thread exits
+	virtual ~FTAFileWriter();
+
+	virtual uint32 Run() override;
+
+	virtual void Stop() override;
+
+	void Enqueue(TFunction<void()>&& Task);
+
+	// blocks until every task queued so far has run
+	void Flush();
+
+	// runs what is queued and joins the thread, later tasks run inline on the caller
+	void Shutdown();
+
+	int32 PendingNum();
+
+private:
+
+	TQueue<TFunction<void()>, EQueueMode::Mpsc> m_Tasks;
+
+	FThreadSafeCounter m_PendingNum;
+
+	FThreadSafeBool m_Stopping;
+
+	FEvent* m_WakeEvent;
+
+	FRunnableThread* m_Thread;
+
+	bool m_UseTaskGraph;
+
+	// a drain job is queued or running
+	std::atomic<bool> m_Draining;
+
+	void Drain();
+
+	void DispatchDrain();
+};
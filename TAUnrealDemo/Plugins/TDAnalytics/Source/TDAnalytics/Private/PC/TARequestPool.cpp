@@ -0,0 +1,63 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#include "TARequestPool.h"
+#include "RequestHelper.h"
+#include "../Common/TALog.h"
+
+FTARequestPool::FTARequestPool(int32 Capacity)
+{
+	m_Requests.Reserve(Capacity);
+	m_FreeRequests.Reserve(Capacity);
+	for (int32 i = 0; i < Capacity; i++)
+	{
+		FRequestHelper* Helper = new FRequestHelper();
+		m_Requests.Add(Helper);
+		m_FreeRequests.Add(Helper);
+	}
+}
+
+FTARequestPool::~FTARequestPool()
+{
+	for (FRequestHelper* Helper : m_Requests)
+	{
+		delete Helper;
+	}
+}
+
+FRequestHelper* FTARequestPool::Acquire()
+{
+	//lock
+	FScopeLock PoolLock(&m_Critical);
+	if ( m_FreeRequests.Num() == 0 )
+	{
+		FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("All %d request contexts are in flight"), m_Requests.Num()));
+		return nullptr;
+	}
+	return m_FreeRequests.Pop(false);
+}
+
+bool FTARequestPool::Release(FRequestHelper* Helper)
+{
+	//lock
+	FScopeLock PoolLock(&m_Critical);
+	if ( !m_Requests.Contains(Helper) || m_FreeRequests.Contains(Helper) )
+	{
+		FTALog::Warning(CUR_LOG_POSITION, TEXT("Release unknown request context !"));
+		return false;
+	}
+	m_FreeRequests.Add(Helper);
+	return true;
+}
+
+int32 FTARequestPool::Num()
+{
+	//lock
+	FScopeLock PoolLock(&m_Critical);
+	return m_Requests.Num();
+}
+
+int32 FTARequestPool::FreeNum()
+{
+	//lock
+	FScopeLock PoolLock(&m_Critical);
+	return m_FreeRequests.Num();
+}
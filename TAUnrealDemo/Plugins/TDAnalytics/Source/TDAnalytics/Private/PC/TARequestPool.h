@@ -0,0 +1,36 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FRequestHelper;
+
+// request contexts of one FTaskHandle, a fixed set created up front and reused. the set never grows, a long
+// session holds the same contexts from start to end
+class FTARequestPool
+{
+public:
+
+	// Capacity is the most requests the handle keeps in flight at once
+	explicit FTARequestPool(int32 Capacity);
+
+	~FTARequestPool();
+
+	// a free context, nullptr if every context is in flight
+	FRequestHelper* Acquire();
+
+	// false for a context that is not from this pool or already free
+	bool Release(FRequestHelper* Helper);
+
+	int32 Num();
+
+	int32 FreeNum();
+
+private:
+
+	FCriticalSection m_Critical;
+
+	TArray<FRequestHelper*> m_Requests;
+
+	TArray<FRequestHelper*> m_FreeRequests;
+};
@@ -7,12 +7,14 @@
 #include "GameFramework/SaveGame.h"
 #include "TASaveEvent.generated.h"
 
+// legacy event slot, only read once to import its events into the event store
 UCLASS()
 class UTASaveEvent : public USaveGame
 {
     GENERATED_BODY()
 public:
 
+    // json events joined by "#tad"
     UPROPERTY(VisibleAnywhere, Category = Basic)
     FString EventJsonContent;
 
@@ -20,12 +22,4 @@ public:
     uint32 UserIndex;
 
 	UTASaveEvent();
-
-    void AddEvent(TSharedPtr<FJsonObject> EventJson);
-
-    TArray<TSharedPtr<FJsonObject>> GetEvents(uint32 Count);
-
-    void RemoveEvents(uint32 Count);
-
-    uint32 Num();
-};
\ No newline at end of file
+};
@@ -0,0 +1,339 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#include "TAScheduler.h"
+#include "TaskHandle.h"
+#include "../Common/TALog.h"
+#include "TDAnalyticsSettings.h"
+
+#include "CoreGlobals.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HttpModule.h"
+#include "HttpManager.h"
+
+static EThreadPriority ToThreadPriority(TAThreadPriority Priority)
+{
+	switch ( Priority )
+	{
+	case TAThreadPriority::LOWEST:
+		return TPri_Lowest;
+	case TAThreadPriority::NORMAL:
+		return TPri_Normal;
+	case TAThreadPriority::ABOVE_NORMAL:
+		return TPri_AboveNormal;
+	default:
+		return TPri_BelowNormal;
+	}
+}
+
+FTAScheduler& FTAScheduler::Get()
+{
+	static FTAScheduler* Scheduler = new FTAScheduler(GetDefault<UTDAnalyticsSettings>()->ExecutionMode == TAExecutionMode::TASK_GRAPH);
+	return *Scheduler;
+}
+
+FTAScheduler::FTAScheduler(bool UseTaskGraph)
+{
+	const UTDAnalyticsSettings* Settings = GetDefault<UTDAnalyticsSettings>();
+	// persisting is due every PersistIntervalMs, ticks do not need to be more frequent
+	m_TickInterval = FMath::Clamp(Settings->PersistIntervalMs, 50, 1000) / 1000.0;
+	m_LastTickTime = FPlatformTime::Seconds();
+	m_WakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	m_UseTaskGraph = UseTaskGraph;
+	if ( m_UseTaskGraph && IsRunningCommandlet() )
+	{
+		// no game loop, nothing would tick
+		FTALog::Warning(CUR_LOG_POSITION, TEXT("Commandlet, task graph mode runs on worker threads"));
+		m_UseTaskGraph = false;
+	}
+	if ( m_UseTaskGraph )
+	{
+#if ENGINE_MAJOR_VERSION >= 5
+		m_TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FTAScheduler::OnTick), m_TickInterval);
+#else
+		m_TickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FTAScheduler::OnTick), m_TickInterval);
+#endif // ENGINE_MAJOR_VERSION >= 5
+		return;
+	}
+	StartWorkers();
+}
+
+FTAScheduler::~FTAScheduler()
+{
+	Shutdown(0);
+	FPlatformProcess::ReturnSynchEventToPool(m_WakeEvent);
+}
+
+void FTAScheduler::StartWorkers()
+{
+	const UTDAnalyticsSettings* Settings = GetDefault<UTDAnalyticsSettings>();
+	uint64 AffinityMask = Settings->WorkerAffinityMask != 0 ? (uint64)Settings->WorkerAffinityMask : FPlatformAffinity::GetPoolThreadMask();
+	int32 WorkerNum = FMath::Max(Settings->WorkerThreadNum, 1);
+	for (int32 i = 0; i < WorkerNum; i++)
+	{
+		FWorker* Worker = new FWorker(this);
+		FRunnableThread* Thread = FRunnableThread::Create(Worker, *FString::Printf(TEXT("TDAnalyticsWorker%d"), i), 128 * 1024, ToThreadPriority(Settings->WorkerThreadPriority), AffinityMask);
+		if ( !Thread )
+		{
+			delete Worker;
+			FTALog::Warning(CUR_LOG_POSITION, TEXT("Create worker thread failed !"));
+			break;
+		}
+		m_Workers.Add(Worker);
+		m_Threads.Add(Thread);
+	}
+}
+
+bool FTAScheduler::IsUsingTaskGraph()
+{
+	//lock
+	FScopeLock SchedulerLock(&m_Critical);
+	return m_UseTaskGraph;
+}
+
+void FTAScheduler::Register(FTaskHandle* Handle)
+{
+	//lock
+	FScopeLock SchedulerLock(&m_Critical);
+	m_Handles.AddUnique(Handle);
+}
+
+void FTAScheduler::Schedule(FTaskHandle* Handle)
+{
+	{
+		//lock
+		FScopeLock SchedulerLock(&m_Critical);
+		if ( m_Stopping )
+		{
+			return;
+		}
+		if ( m_UseTaskGraph && FPlatformTime::Seconds() - m_LastTickTime >= TICK_STALL_SECONDS )
+		{
+			// a dedicated tool or server without a core tick, time based persisting would never run
+			FTALog::Warning(CUR_LOG_POSITION, TEXT("Core ticker stalled, task graph mode falls back to worker threads"));
+			m_UseTaskGraph = false;
+			StartWorkers();
+		}
+		EHandleState& State = m_States.FindOrAdd(Handle, EHandleState::Idle);
+		if ( State == EHandleState::Running )
+		{
+			State = EHandleState::RunAgain;
+			return;
+		}
+		if ( State != EHandleState::Idle )
+		{
+			return;
+		}
+		QueueHandle(Handle, State);
+	}
+	m_WakeEvent->Trigger();
+}
+
+void FTAScheduler::QueueHandle(FTaskHandle* Handle, EHandleState& State)
+{
+	State = EHandleState::Queued;
+	if ( m_UseTaskGraph )
+	{
+		FFunctionGraphTask::CreateAndDispatchWhenReady([this, Handle]()
+		{
+			RunHandle(Handle);
+		}, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+	}
+	else
+	{
+		m_ReadyHandles.Add(Handle);
+	}
+}
+
+void FTAScheduler::TickHandles()
+{
+	m_LastTickTime = FPlatformTime::Seconds();
+	for (FTaskHandle* Handle : m_Handles)
+	{
+		EHandleState& State = m_States.FindOrAdd(Handle, EHandleState::Idle);
+		if ( State == EHandleState::Idle )
+		{
+			QueueHandle(Handle, State);
+		}
+	}
+}
+
+bool FTAScheduler::OnTick(float DeltaTime)
+{
+	//lock
+	FScopeLock SchedulerLock(&m_Critical);
+	if ( m_Stopping || !m_UseTaskGraph )
+	{
+		// the workers tick after a fallback
+		return false;
+	}
+	TickHandles();
+	return true;
+}
+
+void FTAScheduler::RunHandle(FTaskHandle* Handle)
+{
+	{
+		//lock
+		FScopeLock SchedulerLock(&m_Critical);
+		if ( m_Stopping )
+		{
+			m_States.FindOrAdd(Handle) = EHandleState::Idle;
+			return;
+		}
+		m_States.FindOrAdd(Handle) = EHandleState::Running;
+	}
+	FinishHandle(Handle, Handle->DoWork());
+}
+
+FTaskHandle* FTAScheduler::PopReadyHandle()
+{
+	//lock
+	FScopeLock SchedulerLock(&m_Critical);
+	if ( m_Stopping )
+	{
+		return nullptr;
+	}
+	if ( FPlatformTime::Seconds() - m_LastTickTime >= m_TickInterval )
+	{
+		TickHandles();
+	}
+
+	if ( m_ReadyHandles.Num() == 0 )
+	{
+		return nullptr;
+	}
+	FTaskHandle* Handle = m_ReadyHandles[0];
+	m_ReadyHandles.RemoveAt(0);
+	m_States.FindOrAdd(Handle) = EHandleState::Running;
+	return Handle;
+}
+
+void FTAScheduler::FinishHandle(FTaskHandle* Handle, bool HasMore)
+{
+	//lock
+	FScopeLock SchedulerLock(&m_Critical);
+	EHandleState& State = m_States.FindOrAdd(Handle);
+	if ( !m_Stopping && (HasMore || State == EHandleState::RunAgain) )
+	{
+		// back of the line, the other instances get their slice first
+		QueueHandle(Handle, State);
+	}
+	else
+	{
+		State = EHandleState::Idle;
+	}
+}
+
+void FTAScheduler::WorkerLoop()
+{
+	while ( !m_Stopping )
+	{
+		FTaskHandle* Handle = PopReadyHandle();
+		if ( !Handle )
+		{
+			m_WakeEvent->Wait((uint32)(m_TickInterval * 1000));
+			continue;
+		}
+		FinishHandle(Handle, Handle->DoWork());
+	}
+}
+
+FTAScheduler::FWorker::FWorker(FTAScheduler* Scheduler)
+{
+	m_Scheduler = Scheduler;
+}
+
+uint32 FTAScheduler::FWorker::Run()
+{
+	m_Scheduler->WorkerLoop();
+	return 0;
+}
+
+void FTAScheduler::FWorker::Stop()
+{
+	m_Scheduler->m_Stopping = true;
+	m_Scheduler->m_WakeEvent->Trigger();
+}
+
+void FTAScheduler::Shutdown(double Timeout)
+{
+	{
+		//lock
+		FScopeLock SchedulerLock(&m_Critical);
+		if ( m_Stopping )
+		{
+			return;
+		}
+		m_Stopping = true;
+		for (FTaskHandle* Handle : m_ReadyHandles)
+		{
+			m_States.FindOrAdd(Handle) = EHandleState::Idle;
+		}
+		m_ReadyHandles.Empty();
+	}
+	if ( m_TickerHandle.IsValid() )
+	{
+#if ENGINE_MAJOR_VERSION >= 5
+		FTSTicker::GetCoreTicker().RemoveTicker(m_TickerHandle);
+#else
+		FTicker::GetCoreTicker().RemoveTicker(m_TickerHandle);
+#endif // ENGINE_MAJOR_VERSION >= 5
+		m_TickerHandle.Reset();
+	}
+
+	// a worker finishes its current slice first
+	for (int32 i = 0; i < m_Threads.Num(); i++)
+	{
+		m_WakeEvent->Trigger();
+		m_Threads[i]->WaitForCompletion();
+		delete m_Threads[i];
+		delete m_Workers[i];
+	}
+	m_Threads.Empty();
+	m_Workers.Empty();
+
+	// task graph jobs, also ones queued before a fallback to worker threads. a queued job finds m_Stopping and returns
+	bool Running = true;
+	while ( Running )
+	{
+		{
+			//lock
+			FScopeLock SchedulerLock(&m_Critical);
+			Running = false;
+			for (auto& Pair : m_States)
+			{
+				Running |= Pair.Value != EHandleState::Idle;
+			}
+		}
+		if ( Running )
+		{
+			FPlatformProcess::Sleep(0.001f);
+		}
+	}
+
+	for (FTaskHandle* Handle : m_Handles)
+	{
+		Handle->Shutdown();
+	}
+
+	// the game loop is over, tick the http manager here until the final uploads are answered
+	double Deadline = FPlatformTime::Seconds() + Timeout;
+	while ( FPlatformTime::Seconds() < Deadline )
+	{
+		bool Uploading = false;
+		for (FTaskHandle* Handle : m_Handles)
+		{
+			Uploading |= Handle->IsUploading();
+		}
+		if ( !Uploading )
+		{
+			break;
+		}
+		FHttpModule::Get().GetHttpManager().Tick(0.01f);
+		FPlatformProcess::Sleep(0.01f);
+	}
+
+	FTALog::Warning(CUR_LOG_POSITION, TEXT("TDAnalytics background work shut down"));
+}
@@ -0,0 +1,120 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "Containers/Ticker.h"
+
+class FRunnableThread;
+
+class FTaskHandle;
+
+/**
+ * Worker pool shared by every SDK instance.
+ *
+ * Instances are queued when they have work and served in turn, one slice at a time, so a busy app id
+ * cannot starve the others. An instance is never run by two workers at once. Idle workers sleep until
+ * work is queued or the next tick, which drives time based persisting.
+ *
+ * In TAExecutionMode::TASK_GRAPH no thread is created: every slice is a background task graph job and
+ * the core ticker drives the tick, so the engine balances SDK work with its own. Commandlets do not pump the
+ * core ticker, they get worker threads, as does a process whose ticker stops for TICK_STALL_SECONDS.
+ */
+class FTAScheduler
+{
+public:
+
+	static FTAScheduler& Get();
+
+	// Get() is the scheduler of the SDK in the mode of the settings, other instances are for the automation tests
+	explicit FTAScheduler(bool UseTaskGraph);
+
+	~FTAScheduler();
+
+	// adds the handle to the periodic tick
+	void Register(FTaskHandle* Handle);
+
+	void Schedule(FTaskHandle* Handle);
+
+	// stops the workers, drains every handle on the calling thread and waits up to Timeout seconds for the final uploads
+	void Shutdown(double Timeout);
+
+	// false once it runs on worker threads, also after a fallback from the task graph
+	bool IsUsingTaskGraph();
+
+private:
+
+	class FWorker : public FRunnable
+	{
+	public:
+
+		FWorker(FTAScheduler* Scheduler);
+
+		virtual uint32 Run() override;
+
+		virtual void Stop() override;
+
+	private:
+
+		FTAScheduler* m_Scheduler;
+	};
+
+	enum class EHandleState : uint8
+	{
+		Idle,
+		Queued,
+		Running,
+		// scheduled again while running
+		RunAgain
+	};
+
+	bool m_UseTaskGraph;
+
+#if ENGINE_MAJOR_VERSION >= 5
+	FTSTicker::FDelegateHandle m_TickerHandle;
+#else
+	FDelegateHandle m_TickerHandle;
+#endif // ENGINE_MAJOR_VERSION >= 5
+
+	// without a core tick for this long the task graph mode falls back to worker threads
+	constexpr static double TICK_STALL_SECONDS = 5.0;
+
+	FCriticalSection m_Critical;
+
+	TArray<FTaskHandle*> m_Handles;
+
+	TMap<FTaskHandle*, EHandleState> m_States;
+
+	TArray<FTaskHandle*> m_ReadyHandles;
+
+	FEvent* m_WakeEvent;
+
+	FThreadSafeBool m_Stopping;
+
+	TArray<FWorker*> m_Workers;
+
+	TArray<FRunnableThread*> m_Threads;
+
+	double m_TickInterval;
+
+	double m_LastTickTime;
+
+	// creates the worker threads of the settings
+	void StartWorkers();
+
+	void WorkerLoop();
+
+	// queues an idle handle, the lock must be held
+	void QueueHandle(FTaskHandle* Handle, EHandleState& State);
+
+	void TickHandles();
+
+	bool OnTick(float DeltaTime);
+
+	void RunHandle(FTaskHandle* Handle);
+
+	FTaskHandle* PopReadyHandle();
+
+	void FinishHandle(FTaskHandle* Handle, bool HasMore);
+};
@@ -1,8 +1,19 @@
 // Copyright 2021 ThinkingData. All Rights Reserved. Do not repeat initialization 
 #include "TDAnalyticsPC.h"
+#include "TAScheduler.h"
+#include "TAEventStore.h"
+
+#include "Async/Async.h"
+#include "Containers/Ticker.h"
+#include "Misc/CoreDelegates.h"
+#include "PlatformFeatures.h"
+#include "SaveGameSystem.h"
 
 UTDAnalyticsPC::UTDAnalyticsPC(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
+	m_ConfigVersion = 0;
+	m_ConfigSavedVersion = 0;
+	m_ConfigSaveScheduled = false;
 }
 
 UTDAnalyticsPC::~UTDAnalyticsPC()
@@ -35,6 +46,7 @@ void UTDAnalyticsPC::Initialize(const FString& AppID, const FString& ServerUrl,
 		Instance->m_TrackState = Instance->m_SaveConfig->m_TrackState;
 		Instance->m_SuperProperties = Instance->m_SaveConfig->m_SuperProperties;
 		Instance->m_SaveConfig->AddToRoot();
+		FCoreDelegates::OnPreExit.AddUObject(Instance, &UTDAnalyticsPC::OnPreExit);
 		Instance->InitPresetProperties();
 		Instance->m_EventManager = NewObject<UTAEventManager>();
 		Instance->m_EventManager->BindInstance(Instance);
@@ -262,10 +274,103 @@ void UTDAnalyticsPC::SaveValue(UTASaveConfig *SaveConfig)
 {
 	if( !SaveConfig )
     {
-    	FTALog::Warning(CUR_LOG_POSITION, TEXT("SaveValue CreateSaveGameObject Success !"));
-    	SaveConfig = Cast<UTASaveConfig>(UGameplayStatics::CreateSaveGameObject(UTASaveConfig::StaticClass()));
+    	FTALog::Warning(CUR_LOG_POSITION, TEXT("Passing a nullptr UTASaveConfig !"));
+    	return;
     }
-	UGameplayStatics::SaveGameToSlot(SaveConfig, this->InstanceAppID, FTAConstants::USER_INDEX_CONFIG);
+
+	// the change is live in memory already, the write is coalesced
+	m_ConfigVersion++;
+	if ( m_ConfigSaveScheduled )
+	{
+		return;
+	}
+	m_ConfigSaveScheduled = true;
+	float Delay = FMath::Max(GetDefault<UTDAnalyticsSettings>()->ConfigSaveDelayMs, 0) / 1000.0f;
+#if ENGINE_MAJOR_VERSION >= 5
+	FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UTDAnalyticsPC::OnConfigSaveTick), Delay);
+#else
+	FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UTDAnalyticsPC::OnConfigSaveTick), Delay);
+#endif // ENGINE_MAJOR_VERSION >= 5
+}
+
+bool UTDAnalyticsPC::OnConfigSaveTick(float DeltaTime)
+{
+	m_ConfigSaveScheduled = false;
+	FlushConfig(false);
+	return false;
+}
+
+void UTDAnalyticsPC::FlushConfig(bool Sync)
+{
+	{
+		//lock
+		FScopeLock ConfigLock(&m_ConfigCritical);
+		if ( !m_SaveConfig || m_ConfigVersion == m_ConfigSavedVersion )
+		{
+			return;
+		}
+	}
+
+	// serialized on the calling thread, only the file write moves to the background
+	TArray<uint8> Data;
+	if ( !UGameplayStatics::SaveGameToMemory(m_SaveConfig, Data) )
+	{
+		return;
+	}
+	uint64 Version = m_ConfigVersion;
+	FString SlotName = this->InstanceAppID;
+	auto WriteConfig = [this, SlotName, Data, Version]()
+	{
+		//lock
+		FScopeLock ConfigLock(&m_ConfigCritical);
+		if ( Version <= m_ConfigSavedVersion )
+		{
+			// a newer config is on disk already
+			return;
+		}
+		ISaveGameSystem* SaveSystem = IPlatformFeaturesModule::Get().GetSaveGameSystem();
+		if ( SaveSystem && SaveSystem->SaveGame(false, *SlotName, FTAConstants::USER_INDEX_CONFIG, Data) )
+		{
+			m_ConfigSavedVersion = Version;
+		}
+		else
+		{
+			FTALog::Warning(CUR_LOG_POSITION, TEXT("Save config failed !"));
+		}
+	};
+
+	if ( Sync )
+	{
+		WriteConfig();
+	}
+	else
+	{
+		AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, WriteConfig);
+	}
+}
+
+void UTDAnalyticsPC::OnPreExit()
+{
+	Shutdown();
+}
+
+void UTDAnalyticsPC::Shutdown()
+{
+	static bool IsShutdown = false;
+	if ( IsShutdown || TDAnalyticsSingletons.Num() == 0 )
+	{
+		return;
+	}
+	IsShutdown = true;
+
+	// last chance, write whatever is still pending on this thread
+	for (auto& Pair : TDAnalyticsSingletons)
+	{
+		Pair.Value->FlushConfig(true);
+	}
+	FTAScheduler::Get().Shutdown(FMath::Max(GetDefault<UTDAnalyticsSettings>()->ShutdownTimeoutMs, 0) / 1000.0);
+	// the handles are drained, what they stored goes to disk
+	FTAStorageEngine::Get().Shutdown();
 }
 
 UTASaveConfig* UTDAnalyticsPC::ReadValue()
@@ -276,7 +381,8 @@ UTASaveConfig* UTDAnalyticsPC::ReadValue()
     	SaveConfig = Cast<UTASaveConfig>(UGameplayStatics::CreateSaveGameObject(UTASaveConfig::StaticClass()));
 		this->m_DistinctID = ta_GetDeviceID();
 		SaveConfig->SetDistinctID(this->m_DistinctID);
-		UGameplayStatics::SaveGameToSlot(SaveConfig, this->InstanceAppID, FTAConstants::USER_INDEX_CONFIG);
+		this->m_SaveConfig = SaveConfig;
+		SaveValue(SaveConfig);
     	FTALog::Warning(CUR_LOG_POSITION, TEXT("ReadValue CreateSaveGameObject Success !"));
 	}
 	FTALog::Warning(CUR_LOG_POSITION, TEXT("ReadValue Success !"));
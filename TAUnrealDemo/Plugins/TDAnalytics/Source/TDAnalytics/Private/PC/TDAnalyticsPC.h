@@ -40,6 +40,9 @@ public:
 
 	static void SetEnableLog(bool Enable);
 
+	// saves every config, persists queued events and makes one last upload within ShutdownTimeoutMs. runs once
+	static void Shutdown();
+
 	FString InstanceAppID;
 
 	FString ta_GetDeviceID();
@@ -122,6 +125,15 @@ private:
 
 	float m_TimeZone_Offset;
 
+	// config changes bump m_ConfigVersion and are written by a coalesced background save
+	uint64 m_ConfigVersion;
+
+	uint64 m_ConfigSavedVersion;
+
+	bool m_ConfigSaveScheduled;
+
+	FCriticalSection m_ConfigCritical;
+
 	~UTDAnalyticsPC();
 
 	UTASaveConfig* ReadValue();
@@ -130,6 +142,12 @@ private:
 
 	void SaveValue(UTASaveConfig *SaveConfig);
 
+	bool OnConfigSaveTick(float DeltaTime);
+
+	void FlushConfig(bool Sync);
+
+	void OnPreExit();
+
 	void Init(const FString& AppID, const FString& ServerUrl, TAMode Mode, const FString& TimeZone, FString Version);
 
 
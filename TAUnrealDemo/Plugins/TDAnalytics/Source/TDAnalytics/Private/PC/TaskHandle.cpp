@@ -1,112 +1,412 @@
 #include "TaskHandle.h"
+#include "TAScheduler.h"
 
-bool FTaskHandle::Init()
+// progress of an interrupted legacy slot import, kept in the event store directory
+static const TCHAR* LEGACY_IMPORT_META = TEXT("legacy_import");
+
+bool FTaskHandle::DoWork()
 {
-	FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Init")));
-	return true;
+	//lock
+	FScopeLock SetLock(&SetCritical);
+	ProcessCompletions();
+	PersistToLocal(false);
+	if ( m_LegacyImport.IsValid() )
+	{
+		ImportLegacyChunk();
+	}
+
+	if ( m_FlushRequested || ShouldFlush(FPlatformTime::Seconds()) )
+	{
+		Flush();
+	}
+
+	// ingestion keeps going while an upload is in flight
+	uint32 TaskNum = 0;
+	FString DataStr;
+	while ( TaskNum < TASK_SLICE && TaskQueue.Dequeue(DataStr) )
+	{
+		TaskNum++;
+		if ( DataStr.IsEmpty() )
+		{
+			Flush();
+		}
+		else
+		{
+			TSharedPtr<FJsonObject> JsonObject = MakeShareable(new FJsonObject);
+			TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(DataStr);
+			FJsonSerializer::Deserialize(Reader, JsonObject);
+			SaveToLocal(JsonObject);
+		}
+	}
+
+	if ( m_DebugQueue.Num() > 0 )
+	{
+		PumpDebug();
+	}
+
+	if ( TaskQueue.IsEmpty() )
+	{
+		// idle, reclaim acknowledged batches and the consumed log head
+		m_Store->Compact();
+		SkipDroppedEvents();
+	}
+	// an import waiting for its sync is scheduled again by the sync
+	return (m_LegacyImport.IsValid() && !m_LegacyImport->Syncing) || !TaskQueue.IsEmpty() || !m_Completions.IsEmpty() || m_FlushRequested;
 }
 
-uint32 FTaskHandle::Run()
+void FTaskHandle::AddTask(FString EventJsonStr)
 {
-	FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Run")));
-	while(true)
+	if ( m_Closed )
 	{
-		//lock
-		FScopeLock SetLock(&SetCritical);
-		if ( !IsPaused && !Working )
+		FTALog::Warning(CUR_LOG_POSITION, TEXT("SDK is shutting down, event dropped !"));
+		return;
+	}
+	FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("AddTask")));
+	TaskQueue.Enqueue(EventJsonStr);
+	m_Scheduler->Schedule(this);
+}
+
+void FTaskHandle::Shutdown()
+{
+	//lock
+	FScopeLock SetLock(&SetCritical);
+	m_Closed = true;
+	ProcessCompletions();
+	FString DataStr;
+	while ( TaskQueue.Dequeue(DataStr) )
+	{
+		if ( !DataStr.IsEmpty() )
 		{
-			// FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Run  %d"), TaskArray.Num()));
-			// 0.001s
-#if PLATFORM_HAS_BSD_TIME
-			FGenericPlatformProcess::Sleep(0.001f);
-#endif // PLATFORM_HAS_BSD_TIME
-			if ( TaskArray.Num() > 0 )
-			{
-				FString DataStr = TaskArray[0];
-				// FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Flush==%s=="), *DataStr));
-				if ( DataStr.IsEmpty() )
-				{	
-					// FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Flush")));
-					Flush();
-				}
-				else
-				{
-					TSharedPtr<FJsonObject> JsonObject = MakeShareable(new FJsonObject);
-					TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(DataStr);
-					FJsonSerializer::Deserialize(Reader, JsonObject);
-					// FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("SaveToLocal")));
-					SaveToLocal(JsonObject);
-				}
-			}
-			else
-			{
-				IsPaused = true;
-			}
+			TSharedPtr<FJsonObject> JsonObject = MakeShareable(new FJsonObject);
+			TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(DataStr);
+			FJsonSerializer::Deserialize(Reader, JsonObject);
+			SaveToLocal(JsonObject);
 		}
 	}
-	return 0;
+	PersistToLocal(true);
+	Flush();
+}
+
+bool FTaskHandle::IsUploading()
+{
+	//lock
+	FScopeLock UploadLock(&m_UploadCritical);
+	return m_InFlightNum > 0;
 }
 
-void FTaskHandle::Stop()
+bool FTaskHandle::AcquireUpload(int32 Window)
 {
-	FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Stop")));
+	//lock
+	FScopeLock UploadLock(&m_UploadCritical);
+	if ( m_InFlightNum >= Window )
+	{
+		return false;
+	}
+	m_InFlightNum++;
+	return true;
 }
 
-void FTaskHandle::Exit()
+void FTaskHandle::ReleaseUpload(uint64 BatchSeq)
 {
-	FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Exit")));
+	//lock
+	FScopeLock UploadLock(&m_UploadCritical);
+	m_InFlightNum = FMath::Max(m_InFlightNum - 1, 0);
+	m_InFlightSeqs.Remove(BatchSeq);
 }
 
-void FTaskHandle::AddTask(FString EventJsonStr)
+void FTaskHandle::ReleaseRequest(FRequestHelper* Helper)
 {
-	FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("AddTask %d"), TaskArray.Num()));
-	TaskArray.Add(EventJsonStr);
-	IsPaused = false;
+	m_RequestPool.Release(Helper);
 }
 
 FTaskHandle::FTaskHandle(UTDAnalyticsPC* Instance)
+	: FTaskHandle(Instance, &FTAScheduler::Get(), &FTAStorageEngine::Get())
 {
-	Working = false;
-	IsPaused = true;
+}
+
+FTaskHandle::FTaskHandle(UTDAnalyticsPC* Instance, FTAScheduler* Scheduler, FTAStorageEngine* Engine)
+	: m_RequestPool(FMath::Max(GetDefault<UTDAnalyticsSettings>()->MaxInFlightBatches, 1) + FMath::Max(GetDefault<UTDAnalyticsSettings>()->MaxDebugInFlight, 1))
+{
+	m_InFlightNum = 0;
 	m_Instance = Instance;
 	m_Instance->AddToRoot();
+	m_Scheduler = Scheduler;
 	m_SaveName = m_Instance->InstanceAppID + FTAConstants::KEY_SAVE_EVENT_SUFFIX;
 
+	const UTDAnalyticsSettings* Settings = GetDefault<UTDAnalyticsSettings>();
+	m_PersistGroupSize = FMath::Max(Settings->PersistGroupSize, 1);
+	m_MaxInFlight = FMath::Max(Settings->MaxInFlightBatches, 1);
+	m_MaxDebugInFlight = FMath::Max(Settings->MaxDebugInFlight, 1);
+	m_MinBatchEvents = FMath::Max(Settings->MinBatchEvents, 1);
+	m_MaxBatchEvents = FMath::Max(Settings->MaxBatchEvents, (int32)m_MinBatchEvents);
+	m_BatchEventNum = FMath::Clamp(50u, m_MinBatchEvents, m_MaxBatchEvents);
+	m_MinBatchBytes = FMath::Max(Settings->MinBatchKB, 1) * 1024.0;
+	m_MaxBatchBytes = FMath::Max((double)Settings->MaxBatchKB * 1024.0, m_MinBatchBytes);
+	m_TargetBatchBytes = FMath::Clamp(64 * 1024.0, m_MinBatchBytes, m_MaxBatchBytes);
+	m_BytesPerEvent = 0;
+	m_CompressNum = 0;
+	m_CompressRawBytes = 0;
+	m_CompressedBytes = 0;
+	m_CompressCycles = 0;
+	AppendUtf8(m_BatchHeader, FString::Printf(TEXT("{\"%s\":["), ANSI_TO_TCHAR(FTAConstants::KEY_DATA)));
+	AppendUtf8(m_BatchFooter, FString::Printf(TEXT("],\"%s\":\"%s\",\"%s\":\""), ANSI_TO_TCHAR(FTAConstants::KEY_APP_ID),
+		*m_Instance->InstanceAppID.ReplaceCharWithEscapedChar(), ANSI_TO_TCHAR(FTAConstants::KEY_FLUSH_TIME)));
+	AppendUtf8(m_UserTypeTag, FString::Printf(TEXT("\"%s\":\"user"), ANSI_TO_TCHAR(FTAConstants::KEY_TYPE)));
+	m_PersistInterval = FMath::Max(Settings->PersistIntervalMs, 0) / 1000.0;
+	m_UnsavedNum = 0;
+	m_LastSaveTime = FPlatformTime::Seconds();
+	// events recovered from disk wait no longer than new ones
+	m_LastFlushTime = m_LastSaveTime;
+	m_LastEventTime = m_LastSaveTime;
+	m_RetryNum = 0;
+	m_RetryAt = 0;
+	m_DebugStoredNum = 0;
+	m_NextDebugSeq = 0;
+	switch ( Settings->UploadEncoding )
+	{
+	case TAUploadEncoding::GZIP:
+		m_Encoding = EUploadEncoding::Gzip;
+		break;
+	case TAUploadEncoding::BASE64:
+		m_Encoding = EUploadEncoding::Base64;
+		break;
+	default:
+		m_Encoding = EUploadEncoding::Probing;
+		break;
+	}
+
 	//lock
 	FScopeLock SetLock(&SetCritical);
-	m_SaveEvent = Cast<UTASaveEvent>(UGameplayStatics::LoadGameFromSlot(m_SaveName, FTAConstants::USER_INDEX_EVENT));
+	m_Store = Engine->OpenPartition(m_Instance->InstanceAppID);
+	m_Store->SetLimits((int64)FMath::Max(Settings->MaxCacheSizeMB, 0) * 1024 * 1024, (int64)FMath::Max(Settings->MaxCacheDays, 0) * 24 * 3600,
+		Settings->CacheEvictionPolicy == TACacheEvictionPolicy::TRACK_EVENTS_FIRST);
+	StartLegacyImport();
+}
 
-	if ( !m_SaveEvent )
+void FTaskHandle::StartLegacyImport()
+{
+	if ( !UGameplayStatics::DoesSaveGameExist(m_SaveName, FTAConstants::USER_INDEX_EVENT) )
 	{
-		m_SaveEvent = Cast<UTASaveEvent>(UGameplayStatics::CreateSaveGameObject(UTASaveEvent::StaticClass()));
-		UGameplayStatics::SaveGameToSlot(m_SaveEvent, m_SaveName, FTAConstants::USER_INDEX_EVENT);
+		// the slot went but the marker did not
+		m_Store->DeleteMeta(LEGACY_IMPORT_META);
+		return;
 	}
 
-	m_SaveEvent->AddToRoot();
+	// the slot is loaded without blocking the game thread, DoWork() streams it into the store
+	FAsyncLoadGameFromSlotDelegate LoadedDelegate;
+	LoadedDelegate.BindRaw(this, &FTaskHandle::OnLegacySlotLoaded);
+	UGameplayStatics::AsyncLoadGameFromSlot(m_SaveName, FTAConstants::USER_INDEX_EVENT, LoadedDelegate);
 }
 
-void FTaskHandle::Flush()
+void FTaskHandle::OnLegacySlotLoaded(const FString& SlotName, const int32 UserIndex, USaveGame* SaveGame)
+{
+	UTASaveEvent* SaveEvent = Cast<UTASaveEvent>(SaveGame);
+	if ( !SaveEvent )
+	{
+		FTALog::Warning(CUR_LOG_POSITION, TEXT("Load legacy events failed !"));
+		return;
+	}
+
+	TSharedPtr<FTALegacyImport> Import = MakeShareable(new FTALegacyImport);
+	Import->EventJsonContent = MoveTemp(SaveEvent->EventJsonContent);
+
+	TArray<uint8> Progress;
+	if ( m_Store->ReadMeta(LEGACY_IMPORT_META, Progress) && Progress.Num() == 4 )
+	{
+		// resume an interrupted import
+		Import->SkipEventNum = FTAEventRecord::ReadUInt32(Progress.GetData());
+		FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Resume legacy import after %d events"), Import->SkipEventNum));
+	}
+
+	// the game thread only hands the slot over, counting and storing run in DoWork()
+	//lock
+	FScopeLock SetLock(&SetCritical);
+	m_LegacyImport = Import;
+	m_Scheduler->Schedule(this);
+}
+
+bool FTaskHandle::CondenseJson(const FString& Json, FString& OutJson)
+{
+	TSharedPtr<FJsonObject> JsonObject;
+	TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(Json);
+	if ( !FJsonSerializer::Deserialize(Reader, JsonObject) || !JsonObject.IsValid() )
+	{
+		return false;
+	}
+	TSharedRef<TJsonWriter<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>::Create(&OutJson);
+	return FJsonSerializer::Serialize(JsonObject.ToSharedRef(), Writer);
+}
+
+void FTaskHandle::ImportLegacyChunk()
 {
 	//lock
 	FScopeLock SetLock(&SetCritical);
-	if ( !Working )
+
+	FTALegacyImport& Import = *m_LegacyImport;
+	if ( Import.Syncing )
 	{
-		if ( !m_Instance->ta_GetTrackState().Equals(FTAConstants::TRACK_STATUS_NORMAL) )
+		int32 SyncState = m_LegacySyncState.GetValue();
+		if ( SyncState != LEGACY_SYNC_PENDING )
 		{
-			TaskArray.RemoveAt(0);
-			return;
+			FinishLegacyImport(SyncState == LEGACY_SYNC_DONE);
+		}
+		return;
+	}
+	uint32 ChunkNum = 0;
+
+	int32 JsonLen = Import.EventJsonContent.Len();
+	while ( ChunkNum < LEGACY_IMPORT_CHUNK && Import.JsonOffset < JsonLen )
+	{
+		int32 End = Import.EventJsonContent.Find(TEXT("#tad"), ESearchCase::CaseSensitive, ESearchDir::FromStart, Import.JsonOffset);
+		if ( End == INDEX_NONE )
+		{
+			End = JsonLen;
+		}
+		if ( End > Import.JsonOffset )
+		{
+			if ( Import.EventNum++ >= Import.SkipEventNum )
+			{
+				// batch bodies splice the stored json as is, it has to be one condensed object
+				FString EventJson;
+				if ( CondenseJson(Import.EventJsonContent.Mid(Import.JsonOffset, End - Import.JsonOffset), EventJson) )
+				{
+					m_Store->AddEvent(EventJson);
+				}
+				else
+				{
+					Import.DroppedNum++;
+				}
+				ChunkNum++;
+			}
 		}
-		Working = true;
-		TaskArray.RemoveAt(0);
-		if ( m_Instance->ta_GetMode() == TAMode::NORMAL )
-	    {
-	    	FlushFromLocalNormal();
-	    }
-	    else if ( m_Instance->ta_GetMode() == TAMode::DEBUG )
-	    {
-	    	FlushFromLocalDebug(nullptr);
-	    }
+		Import.JsonOffset = End + 4;
+	}
+
+	m_Store->Commit();
+	m_UnsavedNum = 0;
+
+	TArray<uint8> Progress;
+	Progress.AddUninitialized(4);
+	FTAEventRecord::WriteUInt32(Progress.GetData(), Import.EventNum);
+	// queued behind the chunk, a crash repeats at most this chunk
+	m_Store->WriteMeta(LEGACY_IMPORT_META, Progress);
+	if ( ChunkNum >= LEGACY_IMPORT_CHUNK )
+	{
+		return;
+	}
+
+	// the walk above counted what was handed over, the slot goes once it reached the disk. waiting for the
+	// writer here would hold a worker, with task graph jobs possibly the one the writer needs
+	Import.Syncing = true;
+	m_LegacySyncState.Set(LEGACY_SYNC_PENDING);
+	m_Store->SyncAsync([this](bool Synced)
+	{
+		m_LegacySyncState.Set(Synced ? LEGACY_SYNC_DONE : LEGACY_SYNC_FAILED);
+		m_Scheduler->Schedule(this);
+	});
+}
+
+void FTaskHandle::FinishLegacyImport(bool Synced)
+{
+	//lock
+	FScopeLock SetLock(&SetCritical);
+
+	// kept alive past the reset below
+	TSharedPtr<FTALegacyImport> ImportPtr = m_LegacyImport;
+	FTALegacyImport& Import = *ImportPtr;
+	m_LegacyImport.Reset();
+	if ( !Synced )
+	{
+		TArray<uint8> Progress;
+		Progress.AddUninitialized(4);
+		FTAEventRecord::WriteUInt32(Progress.GetData(), Import.EventNum);
+		m_Store->WriteMeta(LEGACY_IMPORT_META, Progress);
+		FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Write legacy import failed, keep the slot. events %d"), Import.EventNum));
+		return;
+	}
+
+	UGameplayStatics::DeleteGameInSlot(m_SaveName, FTAConstants::USER_INDEX_EVENT);
+	m_Store->DeleteMeta(LEGACY_IMPORT_META);
+	FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Import legacy events %d, dropped %d malformed events"), Import.EventNum - Import.DroppedNum, Import.DroppedNum));
+}
+
+void FTaskHandle::Flush()
+{
+	//lock
+	FScopeLock SetLock(&SetCritical);
+	m_FlushRequested = false;
+	if ( !m_Instance->ta_GetTrackState().Equals(FTAConstants::TRACK_STATUS_NORMAL) )
+	{
+		return;
+	}
+	double Now = FPlatformTime::Seconds();
+	if ( Now < m_RetryAt )
+	{
+		// backing off, ShouldFlush() fires again once the delay ran out
+		return;
+	}
+	m_LastFlushTime = Now;
+
+	// sealing and compressing run outside the upload lock, completions are not held up
+	if ( m_Instance->ta_GetMode() == TAMode::NORMAL )
+    {
+    	// fill the window, every batch is acknowledged on its own. a degraded receiver gets one at a time
+    	int32 Window = m_RetryNum > 0 ? 1 : m_MaxInFlight;
+    	while ( AcquireUpload(Window) && FlushFromLocalNormal() )
+    	{
+    	}
+    }
+    else
+    {
+    	if ( m_Instance->ta_GetMode() == TAMode::DEBUG && m_Store->BatchNum() > 0 )
+    	{
+    		// batches sealed in an earlier NORMAL session go out as they are, new events are not sealed in DEBUG
+    		int32 Window = m_RetryNum > 0 ? 1 : m_MaxInFlight;
+    		while ( AcquireUpload(Window) && FlushFromLocalNormal() )
+    		{
+    		}
+    	}
+    	// DEBUG reads stored events ahead, DEBUG_ONLY events are queued by SaveToLocal()
+    	PumpDebug();
+    }
+}
+
+bool FTaskHandle::ShouldFlush(double Now)
+{
+	uint32 CachedNum = m_Store->Num();
+	if ( CachedNum == 0 )
+	{
+		// nothing to send, no network wakeup
+		return false;
+	}
+
+	if ( m_RetryAt > m_LastFlushTime )
+	{
+		// a failed upload is retried once, when its backoff ran out
+		return Now >= m_RetryAt;
+	}
+
+	// read every time, so the triggers can be tuned at runtime
+	const UTDAnalyticsSettings* Settings = GetDefault<UTDAnalyticsSettings>();
+	if ( m_RetryNum > 0 )
+	{
+		// degraded receiver: no count, size or idle uploads, and the age trigger stretched up to 16 times
+		return Settings->FlushMaxAgeSeconds > 0 && Now - m_LastFlushTime >= Settings->FlushMaxAgeSeconds * (1 << FMath::Min(m_RetryNum, 4u));
+	}
+	if ( Settings->FlushMaxAgeSeconds > 0 && Now - m_LastFlushTime >= Settings->FlushMaxAgeSeconds )
+	{
+		// also picks up a backlog left by an earlier session
+		return true;
+	}
+
+	// the other triggers need events tracked since the last flush, a stuck backlog does not fire them every tick
+	if ( m_LastEventTime <= m_LastFlushTime )
+	{
+		return false;
 	}
+	return (Settings->FlushEventCount > 0 && CachedNum >= (uint32)Settings->FlushEventCount)
+		|| (Settings->FlushSizeKB > 0 && m_Store->Bytes() >= Settings->FlushSizeKB * 1024LL)
+		|| (Settings->FlushIdleSeconds > 0 && Now - m_LastEventTime >= Settings->FlushIdleSeconds);
 }
 
 void FTaskHandle::SaveToLocal(TSharedPtr<FJsonObject> EventJson)
@@ -126,44 +426,315 @@ void FTaskHandle::SaveToLocal(TSharedPtr<FJsonObject> EventJson)
 
 	if ( m_Instance->ta_GetMode() == TAMode::DEBUG_ONLY )
 	{
-		FlushFromLocalDebug(FinalDataObject);
-		TaskArray.RemoveAt(0);
+		// queued only, DoWork() sends it within the debug window
+		FString Data;
+		TSharedRef<TJsonWriter<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>::Create(&Data);
+		FJsonSerializer::Serialize(FinalDataObject.ToSharedRef(), Writer);
+		EnqueueDryRun(Data);
 	}
 	else
 	{
-		m_SaveEvent->AddEvent(FinalDataObject);
-		UGameplayStatics::SaveGameToSlot(m_SaveEvent, m_SaveName, FTAConstants::USER_INDEX_EVENT);
-		uint32 CurrentNum = m_SaveEvent->Num();
-		if ( CurrentNum >= 20 )
+		FString Data;
+		TSharedRef<TJsonWriter<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>::Create(&Data);
+		FJsonSerializer::Serialize(FinalDataObject.ToSharedRef(), Writer);
+
+		m_Store->AddEvent(Data);
+		m_UnsavedNum++;
+		m_LastEventTime = FPlatformTime::Seconds();
+		PersistToLocal(false);
+		if ( m_Instance->ta_GetMode() == TAMode::NORMAL && m_Store->PendingNum() >= m_BatchEventNum )
 		{
-			Flush();
+			// keep the log short, the backlog lives in sealed batches
+			SealLocalEvents();
 		}
-		else
+		if ( ShouldFlush(m_LastEventTime) )
 		{
-			TaskArray.RemoveAt(0);
+			Flush();
 		}
-		FString Data;
-		TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Data);
-		FJsonSerializer::Serialize(FinalDataObject.ToSharedRef(), Writer);
 		FTALog::Warning(CUR_LOG_POSITION, TEXT("SaveToLocal Success !") + Data);
 	}
 }
 
-void FTaskHandle::FlushFromLocalNormal()
+void FTaskHandle::PersistToLocal(bool Force)
 {
-	FTALog::Warning(CUR_LOG_POSITION, TEXT("FlushFromLocalNormal !"));
 	//lock
 	FScopeLock SetLock(&SetCritical);
+	if ( m_UnsavedNum == 0 )
+	{
+		return;
+	}
 
-	TArray<TSharedPtr<FJsonObject>> SendArray = m_SaveEvent->GetEvents(50);
-	if ( SendArray.Num() <= 0)
+	double Now = FPlatformTime::Seconds();
+	if ( Force || m_UnsavedNum >= m_PersistGroupSize || Now - m_LastSaveTime >= m_PersistInterval )
+	{
+		if ( m_Store->Commit() )
+		{
+			m_UnsavedNum = 0;
+		}
+		m_LastSaveTime = Now;
+	}
+}
+
+void FTaskHandle::SealLocalEvents()
+{
+	//lock
+	FScopeLock SetLock(&SetCritical);
+
+	bool Sealed = false;
+	while ( true )
+	{
+		// the stored events are condensed json, they are spliced in without a parse or a DOM
+		m_BatchBody.Reset();
+		m_BatchBody.Append(m_BatchHeader);
+		int32 EventsStart = m_BatchBody.Num();
+		uint32 EventNum = m_Store->GetEventPayloads(m_BatchEventNum, m_BatchBody);
+		if ( EventNum == 0 )
+		{
+			break;
+		}
+		int32 EventsEnd = m_BatchBody.Num();
+		m_BatchBody.Append(m_BatchFooter);
+		AppendUtf8(m_BatchBody, FTAUtils::GetCurrentTimeStamp());
+		m_BatchBody.Append((const uint8*)"\"}", 2);
+
+		uint8 Priority = FTaskHandle::PRIORITY_TRACK;
+		for (int32 i = EventsStart; i + m_UserTypeTag.Num() <= EventsEnd; i++)
+		{
+			if ( FMemory::Memcmp(m_BatchBody.GetData() + i, m_UserTypeTag.GetData(), m_UserTypeTag.Num()) == 0 )
+			{
+				Priority = FTaskHandle::PRIORITY_USER;
+				break;
+			}
+		}
+
+		// more than this batch waiting means a backlog drains, the network is the bottleneck and not the cpu
+		bool Draining = m_Store->PendingNum() >= EventNum + m_BatchEventNum || m_Store->BatchNum() >= (uint32)m_MaxInFlight;
+		uint64 StartCycles = FPlatformTime::Cycles64();
+		TArray<uint8> CompressedData;
+		if ( !FTAUtils::CompressData(m_BatchBody.GetData(), m_BatchBody.Num(), CompressedData, GetCompressionLevel(m_BatchBody.Num(), Draining)) || !m_Store->SealBatch(CompressedData, EventNum, Priority) )
+		{
+			break;
+		}
+		OnBatchSealed(EventNum, m_BatchBody.Num(), CompressedData.Num(), FPlatformTime::Cycles64() - StartCycles);
+		Sealed = true;
+	}
+
+	if ( Sealed )
+	{
+		// drop the sealed prefix from the log
+		if ( m_Store->Commit() )
+		{
+			m_UnsavedNum = 0;
+		}
+	}
+}
+
+int32 FTaskHandle::GetCompressionLevel(int32 RawSize, bool Draining)
+{
+	switch ( GetDefault<UTDAnalyticsSettings>()->CompressionLevel )
+	{
+	case TACompressionLevel::FASTEST:
+		return FTAUtils::GZIP_LEVEL_FASTEST;
+	case TACompressionLevel::DEFAULT:
+		return FTAUtils::GZIP_LEVEL_DEFAULT;
+	case TACompressionLevel::SMALLEST:
+		return FTAUtils::GZIP_LEVEL_SMALLEST;
+	default:
+		break;
+	}
+	if ( RawSize < SMALL_BATCH_BYTES )
+	{
+		return FTAUtils::GZIP_LEVEL_FASTEST;
+	}
+	return Draining ? FTAUtils::GZIP_LEVEL_SMALLEST : FTAUtils::GZIP_LEVEL_DEFAULT;
+}
+
+void FTaskHandle::AppendUtf8(TArray<uint8>& Buffer, const FString& Str)
+{
+	FTCHARToUTF8 ToUtf8Converter(*Str, Str.Len());
+	Buffer.Append((const uint8*)ToUtf8Converter.Get(), ToUtf8Converter.Length());
+}
+
+void FTaskHandle::OnBatchSealed(uint32 EventNum, int32 RawSize, int32 CompressedSize, uint64 Cycles)
+{
+	m_CompressNum++;
+	m_CompressRawBytes += RawSize;
+	m_CompressedBytes += CompressedSize;
+	m_CompressCycles += Cycles;
+	if ( m_CompressNum % COMPRESS_STATS_BATCHES == 0 )
+	{
+		FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Compressed %d batches, ratio %.2f, %.3f ms per batch, %d events evicted by the cache limits"), m_CompressNum,
+			(double)m_CompressRawBytes / FMath::Max(m_CompressedBytes, (int64)1), FPlatformTime::ToMilliseconds64(m_CompressCycles) / m_CompressNum, m_Store->GetEvictedNum()));
+	}
+
+	double BytesPerEvent = (double)CompressedSize / FMath::Max(EventNum, 1u);
+	m_BytesPerEvent = m_BytesPerEvent > 0 ? m_BytesPerEvent * 0.75 + BytesPerEvent * 0.25 : BytesPerEvent;
+	m_BatchEventNum = FMath::Clamp((uint32)(m_TargetBatchBytes / FMath::Max(m_BytesPerEvent, 1.0)), m_MinBatchEvents, m_MaxBatchEvents);
+}
+
+void FTaskHandle::OnBatchUploaded(bool IsSuccess, double Latency)
+{
+	if ( !IsSuccess || Latency > SLOW_UPLOAD_SECONDS )
+	{
+		// back off quickly, a timed out request costs a whole batch
+		m_TargetBatchBytes = FMath::Max(m_TargetBatchBytes * 0.5, m_MinBatchBytes);
+	}
+	else if ( Latency < FAST_UPLOAD_SECONDS )
+	{
+		m_TargetBatchBytes = FMath::Min(m_TargetBatchBytes * 1.25, m_MaxBatchBytes);
+	}
+	else
 	{
-		Working = false;
-    	FTALog::Warning(CUR_LOG_POSITION, TEXT("FlushFromLocalNormal >>> local is Empty"));
 		return;
 	}
+	if ( m_BytesPerEvent > 0 )
+	{
+		m_BatchEventNum = FMath::Clamp((uint32)(m_TargetBatchBytes / m_BytesPerEvent), m_MinBatchEvents, m_MaxBatchEvents);
+	}
+}
+
+bool FTaskHandle::NegotiateEncoding(const FTAUploadResult& Result)
+{
+	if ( m_Encoding == EUploadEncoding::Gzip )
+	{
+		return false;
+	}
+
+	// 400 and 415 refuse the body itself, a 200 only if it says so. any other answer on 200, a {"code":-1}
+	// for bad event data included, means the receiver did read the gzip body
+	if ( Result.Code == 400 || Result.Code == 415 || (Result.Code == 200 && IsUndecodableResponse(Result.Msg)) )
+	{
+		// other gzip batches of the probing window land here too once the encoding is settled
+		if ( m_Encoding == EUploadEncoding::Probing )
+		{
+			m_Encoding = EUploadEncoding::Base64;
+			FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Receiver rejects gzip bodies (code = %d , msg = %s), fall back to base64"), Result.Code, *Result.Msg));
+		}
+		return true;
+	}
+	if ( Result.Code == 200 && m_Encoding == EUploadEncoding::Probing )
+	{
+		m_Encoding = EUploadEncoding::Gzip;
+		FTALog::Warning(CUR_LOG_POSITION, TEXT("Receiver accepts gzip bodies"));
+	}
+	// no answer or a server error says nothing about the encoding
+	return false;
+}
+
+bool FTaskHandle::IsUndecodableResponse(const FString& Msg)
+{
+	FString Message = Msg;
+	TSharedPtr<FJsonObject> Response;
+	TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(Msg);
+	if ( FJsonSerializer::Deserialize(Reader, Response) && Response.IsValid() )
+	{
+		int32 ResponseCode = -1;
+		if ( Response->TryGetNumberField(TEXT("code"), ResponseCode) && ResponseCode == 0 )
+		{
+			return false;
+		}
+		Response->TryGetStringField(TEXT("msg"), Message);
+	}
+	return Message.Contains(TEXT("gzip")) || Message.Contains(TEXT("decode")) || Message.Contains(TEXT("decompress"))
+		|| Message.Contains(TEXT("unzip")) || Message.Contains(TEXT("base64"));
+}
+
+void FTaskHandle::ScheduleRetry(const FTAUploadResult& Result)
+{
+	if ( Result.FinishTime >= m_RetryAt || m_RetryNum == 0 )
+	{
+		// the batches of one window fail together, they count as one failure
+		m_RetryNum++;
+	}
+
+	const UTDAnalyticsSettings* Settings = GetDefault<UTDAnalyticsSettings>();
+	double BaseDelay = FMath::Max(Settings->RetryBaseSeconds, 0.1f);
+	double MaxDelay = FMath::Max(Settings->RetryMaxSeconds, Settings->RetryBaseSeconds);
+	double Backoff = FMath::Min(BaseDelay * (double)(1ull << FMath::Min(m_RetryNum - 1, MAX_BACKOFF_SHIFT)), MaxDelay);
+
+	// full jitter, so clients that failed together do not retry together. a throttling receiver waits at least half
+	bool Throttled = Result.Code == 429 || Result.Code == 503;
+	double Delay = FMath::FRandRange(Throttled ? Backoff * 0.5 : 0.0, Backoff);
+	Delay = FMath::Max(Delay, Result.RetryAfter);
+	m_RetryAt = FMath::Max(m_RetryAt, Result.FinishTime + Delay);
+	FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("Upload failed %d times, retry in %.1f s"), m_RetryNum, m_RetryAt - Result.FinishTime));
+}
+
+bool FTaskHandle::IsRejected(int32 Code)
+{
+	return Code >= 400 && Code < 500 && Code != 408 && Code != 429;
+}
+
+bool FTaskHandle::DropRejectedBatch(const FTAUploadResult& Result)
+{
+	if ( !IsRejected(Result.Code) )
+	{
+		return false;
+	}
+	uint32& RejectedNum = m_RejectedNums.FindOrAdd(Result.BatchSeq);
+	if ( ++RejectedNum < MAX_REJECTED_NUM )
+	{
+		return false;
+	}
+
+	// the receiver answers, it only refuses this batch. keeping it would hold the instance degraded until it expires
+	m_RejectedNums.Remove(Result.BatchSeq);
+	m_Store->RemoveBatch(Result.BatchSeq);
+	m_RetryNum = 0;
+	m_RetryAt = 0;
+	FTALog::Error(CUR_LOG_POSITION, *FString::Printf(TEXT("Drop batch of %d events rejected %d times, code = %d , msg = %s"), Result.EventNum, MAX_REJECTED_NUM, Result.Code, *Result.Msg));
+	if ( m_Store->Num() > 0 && !m_Closed )
+	{
+		m_FlushRequested = true;
+	}
+	return true;
+}
+
+bool FTaskHandle::FlushFromLocalNormal()
+{
+	FTALog::Warning(CUR_LOG_POSITION, TEXT("FlushFromLocalNormal !"));
+	//lock
+	FScopeLock SetLock(&SetCritical);
+
+	TArray<uint64> InFlightSeqs;
+	{
+		//lock
+		FScopeLock UploadLock(&m_UploadCritical);
+		InFlightSeqs = m_InFlightSeqs;
+	}
+	if ( m_Instance->ta_GetMode() == TAMode::NORMAL && m_Store->BatchNum() <= (uint32)InFlightSeqs.Num() )
+	{
+		SealLocalEvents();
+	}
 
-	FRequestHelper* Helper = new FRequestHelper();
+	FRequestHelper* Helper = m_RequestPool.Acquire();
+	if ( !Helper )
+	{
+		ReleaseUpload(0);
+		return false;
+	}
+
+	TArray<uint8> CompressedData;
+	uint32 EventNum = 0;
+	uint64 BatchSeq = 0;
+	if ( !m_Store->PeekBatch(CompressedData, EventNum, BatchSeq, InFlightSeqs) )
+	{
+		m_RequestPool.Release(Helper);
+		ReleaseUpload(0);
+    	FTALog::Warning(CUR_LOG_POSITION, TEXT("FlushFromLocalNormal >>> local is Empty"));
+		return false;
+	}
+	{
+		//lock
+		FScopeLock UploadLock(&m_UploadCritical);
+		m_InFlightSeqs.Add(BatchSeq);
+	}
+	m_SendTimes.Add(BatchSeq, FPlatformTime::Seconds());
+	bool Binary = m_Encoding != EUploadEncoding::Base64;
+	if ( Binary )
+	{
+		m_GzipSeqs.Add(BatchSeq);
+	}
 
 	FString ServerUrl = m_Instance->ta_GetServerUrl();
 	int32 SyncPoint = ServerUrl.Find(TEXT("sync"), ESearchCase::CaseSensitive, ESearchDir::FromEnd);
@@ -173,46 +744,82 @@ void FTaskHandle::FlushFromLocalNormal()
 	}
 
 	ServerUrl += "/sync";
-	TSharedPtr<FJsonObject> DataJsonObject = MakeShareable(new FJsonObject);
-	TArray< TSharedPtr<FJsonValue> > DataArray;
+	Helper->CallHttpRequest(ServerUrl, MoveTemp(CompressedData), Binary, this, EventNum, BatchSeq);
+	return true;
+}
 
-	for (int i = 0; i < SendArray.Num(); ++i)
+void FTaskHandle::EnqueueDryRun(const FString& EventJson)
+{
+	if ( m_DebugQueue.Num() >= DEBUG_QUEUE_LIMIT )
 	{
-		TSharedPtr<FJsonValueObject> DataValue = MakeShareable(new FJsonValueObject(SendArray[i]));
-		DataArray.Add(DataValue);
+		int32 Index = m_DebugQueue.IndexOfByPredicate([](const FTADebugEvent& Event)
+		{
+			return Event.DryRun && !Event.Sending && !Event.Done;
+		});
+		if ( Index != INDEX_NONE )
+		{
+			m_DebugQueue.RemoveAt(Index);
+			FTALog::Warning(CUR_LOG_POSITION, TEXT("Debug queue is full, oldest event dropped !"));
+		}
 	}
-
-	DataJsonObject->SetArrayField(FTAConstants::KEY_DATA, DataArray);
-	DataJsonObject->SetStringField(FTAConstants::KEY_APP_ID, m_Instance->InstanceAppID);
-	DataJsonObject->SetStringField(FTAConstants::KEY_FLUSH_TIME, FTAUtils::GetCurrentTimeStamp());
-
-	FString Data;
-	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Data);
-	FJsonSerializer::Serialize(DataJsonObject.ToSharedRef(), Writer);
-	Helper->CallHttpRequest(ServerUrl, Data, false, this, SendArray.Num());
+	FTADebugEvent Event;
+	Event.Json = EventJson;
+	Event.Seq = ++m_NextDebugSeq;
+	Event.DryRun = true;
+	m_DebugQueue.Add(MoveTemp(Event));
 }
 
-void FTaskHandle::FlushFromLocalDebug(TSharedPtr<FJsonObject> DebugJson)
+void FTaskHandle::PumpDebug()
 {
 	//lock
 	FScopeLock SetLock(&SetCritical);
+	SkipDroppedEvents();
+	if ( FPlatformTime::Seconds() < m_RetryAt )
+	{
+		return;
+	}
 
-	TSharedPtr<FJsonObject> m_DebugJson = DebugJson;
+	if ( m_Instance->ta_GetMode() == TAMode::DEBUG && m_DebugQueue.Num() < DEBUG_READ_AHEAD && m_Store->PendingNum() > m_DebugStoredNum )
+	{
+		// read ahead of the stored events, the ones already queued are skipped
+		TArray<FString> Events;
+		m_Store->GetEventJsons(m_DebugStoredNum, DEBUG_READ_AHEAD - m_DebugQueue.Num(), Events);
+		for (FString& EventJson : Events)
+		{
+			FTADebugEvent Event;
+			Event.Json = MoveTemp(EventJson);
+			Event.Seq = ++m_NextDebugSeq;
+			m_DebugQueue.Add(MoveTemp(Event));
+			m_DebugStoredNum++;
+		}
+	}
 
-	if ( m_DebugJson == nullptr)
+	for (FTADebugEvent& Event : m_DebugQueue)
 	{
-		TArray<TSharedPtr<FJsonObject>> SendArray = m_SaveEvent->GetEvents(1);
-		if ( SendArray.Num()<=0 )
+		if ( Event.Sending || Event.Done )
+		{
+			continue;
+		}
+		if ( !AcquireUpload(m_MaxDebugInFlight) )
+		{
+			break;
+		}
+		if ( !SendDebugEvent(Event) )
 		{
-			Working = false;
-	    	FTALog::Warning(CUR_LOG_POSITION, TEXT("FlushFromLocalDebug >>> local is Empty"));
-			return;
+			ReleaseUpload(0);
+			break;
 		}
-		m_DebugJson = SendArray[0];
+		Event.Sending = true;
 	}
-	
+}
 
-	FRequestHelper* Helper = new FRequestHelper();
+bool FTaskHandle::SendDebugEvent(const FTADebugEvent& Event)
+{
+	FRequestHelper* Helper = m_RequestPool.Acquire();
+	if ( !Helper )
+	{
+		return false;
+	}
 
 	FString ServerUrl = m_Instance->ta_GetServerUrl();
 	int32 SyncPoint = ServerUrl.Find(TEXT("sync"), ESearchCase::CaseSensitive, ESearchDir::FromEnd);
@@ -222,48 +829,198 @@ void FTaskHandle::FlushFromLocalDebug(TSharedPtr<FJsonObject> DebugJson)
 		ServerUrl = ServerUrl.Left(SyncPoint);
 	}
 	// 
-	FString m_DataStr;
 	FString ServerData;
 	ServerUrl += "/data_debug";
 	ServerData += "appid=";
 	ServerData += m_Instance->InstanceAppID;
 	ServerData += "&deviceId=";
 	ServerData += m_Instance->ta_GetDeviceID();
-	if ( m_DebugJson != nullptr )
+	if ( Event.DryRun )
 	{
 		ServerData += "&dryRun=1";
 	}
 	ServerData += "&source=client&data=";
+	ServerData += FGenericPlatformHttp::UrlEncode(Event.Json);
+	Helper->CallHttpRequest(ServerUrl, ServerData, this, 1, Event.Seq);
+	return true;
+}
 
-	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&m_DataStr);
-	FJsonSerializer::Serialize(m_DebugJson.ToSharedRef(), Writer);
+void FTaskHandle::CompleteDebug(const FTAUploadResult& Result)
+{
+	SkipDroppedEvents();
+	int32 Index = m_DebugQueue.IndexOfByPredicate([&Result](const FTADebugEvent& Event)
+	{
+		return Event.Seq == Result.BatchSeq;
+	});
+	FTADebugEvent* Event = Index != INDEX_NONE ? &m_DebugQueue[Index] : nullptr;
 
-	ServerData += FGenericPlatformHttp::UrlEncode(m_DataStr);
-	Helper->CallHttpRequest(ServerUrl, ServerData, true, this, 1);
+	bool Rejected = false;
+	if ( Result.Code == 200 )
+	{
+		if ( m_RetryNum > 0 )
+		{
+			m_RetryNum--;
+		}
+		FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("code = %d"), Result.Code));
+	}
+	else if ( Event && IsRejected(Result.Code) && ++Event->RejectedNum >= MAX_REJECTED_NUM )
+	{
+		// the queue is delivered in order, a refused event would hold it and the store head behind it forever
+		Rejected = true;
+		m_RetryNum = 0;
+		m_RetryAt = 0;
+		FTALog::Error(CUR_LOG_POSITION, *FString::Printf(TEXT("Drop debug event rejected %d times, code = %d , msg = %s"), MAX_REJECTED_NUM, Result.Code, *Result.Msg));
+	}
+	else
+	{
+		FTALog::Error(CUR_LOG_POSITION, *FString::Printf(TEXT("success = %s , code = %s , msg = %s"), *(UKismetStringLibrary::Conv_BoolToString(Result.IsSuccess)), *FString::FromInt(Result.Code), *Result.Msg));
+		ScheduleRetry(Result);
+	}
+
+	if ( Event )
+	{
+		// a stored event goes again after the backoff, a dry run only feeds the debug view and is dropped
+		Event->Sending = false;
+		Event->Done = Result.Code == 200 || Rejected || Event->DryRun || Event->Dropped;
+	}
+	RemoveDeliveredDebugEvents();
+
+	ReleaseUpload(0);
+	if ( !m_Closed )
+	{
+		PumpDebug();
+	}
 }
 
-void FTaskHandle::RequestCallback(FString Msg, int32 Code, bool IsSuccess, uint32 EventNum)
+void FTaskHandle::RequestCallback(FString Msg, int32 Code, bool IsSuccess, uint32 EventNum, uint64 BatchSeq, double RetryAfter, bool IsDebug)
+{
+	// runs on the game thread: only hand the result over, the worker acknowledges it
+	FTAUploadResult Result;
+	Result.Msg = MoveTemp(Msg);
+	Result.Code = Code;
+	Result.IsSuccess = IsSuccess;
+	Result.EventNum = EventNum;
+	Result.BatchSeq = BatchSeq;
+	Result.FinishTime = FPlatformTime::Seconds();
+	Result.RetryAfter = RetryAfter;
+	Result.IsDebug = IsDebug;
+	m_Completions.Enqueue(MoveTemp(Result));
+	if ( m_Closed )
+	{
+		// the workers are gone during shutdown
+		ProcessCompletions();
+		return;
+	}
+	m_Scheduler->Schedule(this);
+}
+
+void FTaskHandle::ProcessCompletions()
 {
 	//lock
 	FScopeLock SetLock(&SetCritical);
-	if ( Code == 200 )
+	FTAUploadResult Result;
+	while ( m_Completions.Dequeue(Result) )
+	{
+		CompleteUpload(Result);
+	}
+}
+
+void FTaskHandle::CompleteUpload(const FTAUploadResult& Result)
+{
+	if ( Result.IsDebug )
 	{
-		if ( m_Instance->ta_GetMode() != TAMode::DEBUG_ONLY )
+		CompleteDebug(Result);
+		return;
+	}
+
+	if ( m_GzipSeqs.Remove(Result.BatchSeq) > 0 && NegotiateEncoding(Result) )
+	{
+		m_SendTimes.Remove(Result.BatchSeq);
+		ReleaseUpload(Result.BatchSeq);
+		if ( !m_Closed )
 		{
-			m_SaveEvent->RemoveEvents(EventNum);
-			UGameplayStatics::SaveGameToSlot(m_SaveEvent, m_SaveName, FTAConstants::USER_INDEX_EVENT);
-			FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("code = %d"), Code));
+			m_FlushRequested = true;
 		}
-		Working = false;
-		if ( m_SaveEvent->Num() > 0 )
+		return;
+	}
+
+	double SendTime = 0;
+	if ( Result.BatchSeq != 0 && m_SendTimes.RemoveAndCopyValue(Result.BatchSeq, SendTime) )
+	{
+		OnBatchUploaded(Result.Code == 200, Result.FinishTime - SendTime);
+	}
+	if ( Result.Code != 200 && DropRejectedBatch(Result) )
+	{
+		ReleaseUpload(Result.BatchSeq);
+		return;
+	}
+	m_RejectedNums.Remove(Result.BatchSeq);
+	if ( Result.Code == 200 )
+	{
+		if ( m_RetryNum > 0 )
 		{
-			Flush();
+			// recover step by step, the window and the flush cadence widen again
+			m_RetryNum--;
+		}
+		m_Store->RemoveBatch(Result.BatchSeq);
+		FTALog::Warning(CUR_LOG_POSITION, *FString::Printf(TEXT("code = %d"), Result.Code));
+		if ( m_Store->Num() > 0 && !m_Closed )
+		{
+			m_FlushRequested = true;
 		}
 	}
 	else
 	{
-		FTALog::Error(CUR_LOG_POSITION, *FString::Printf(TEXT("success = %s , code = %s , msg = %s"), *(UKismetStringLibrary::Conv_BoolToString(IsSuccess)), *FString::FromInt(Code), *Msg));
-		// TaskArray.Insert(TEXT(""), 0);
-		Working = false;
+		FTALog::Error(CUR_LOG_POSITION, *FString::Printf(TEXT("success = %s , code = %s , msg = %s"), *(UKismetStringLibrary::Conv_BoolToString(Result.IsSuccess)), *FString::FromInt(Result.Code), *Result.Msg));
+		ScheduleRetry(Result);
 	}
-}
\ No newline at end of file
+	ReleaseUpload(Result.BatchSeq);
+}
+
+void FTaskHandle::SkipDroppedEvents()
+{
+	uint32 DroppedNum = m_Store->TakeDroppedNum();
+	if ( DroppedNum == 0 )
+	{
+		return;
+	}
+
+	// the stored events of the queue are the head of the store in order, the dropped ones are the first of them
+	for (FTADebugEvent& Event : m_DebugQueue)
+	{
+		if ( DroppedNum == 0 )
+		{
+			break;
+		}
+		if ( Event.DryRun || Event.Dropped )
+		{
+			continue;
+		}
+		// one in flight is only forgotten once it completes
+		Event.Dropped = true;
+		Event.Done = !Event.Sending;
+		m_DebugStoredNum--;
+		DroppedNum--;
+	}
+	RemoveDeliveredDebugEvents();
+}
+
+void FTaskHandle::RemoveDeliveredDebugEvents()
+{
+	int32 DoneNum = 0;
+	uint32 StoredNum = 0;
+	while ( DoneNum < m_DebugQueue.Num() && m_DebugQueue[DoneNum].Done )
+	{
+		StoredNum += m_DebugQueue[DoneNum].DryRun || m_DebugQueue[DoneNum].Dropped ? 0 : 1;
+		DoneNum++;
+	}
+	if ( DoneNum > 0 )
+	{
+		m_DebugQueue.RemoveAt(0, DoneNum, false);
+	}
+	if ( StoredNum > 0 )
+	{
+		m_Store->RemoveEvents(StoredNum);
+		m_DebugStoredNum -= StoredNum;
+	}
+}
@@ -6,47 +6,338 @@
 #include "../Common/TALog.h"
 #include "../Common/TAUtils.h"
 #include "TASaveEvent.h"
+#include "TAEventStore.h"
+#include "TARequestPool.h"
 #include "Kismet/KismetStringLibrary.h"
+#include "Containers/Queue.h"
+#include "HAL/ThreadSafeCounter.h"
 
-class FTaskHandle : public FRunnable
+class FTAScheduler;
+
+// content of the legacy UTASaveEvent slot, streamed into the event store chunk by chunk
+struct FTALegacyImport
+{
+	FString EventJsonContent;
+
+	int32 JsonOffset = 0;
+
+	// events walked so far, the progress marker stores it
+	uint32 EventNum = 0;
+
+	// already imported before an interruption
+	uint32 SkipEventNum = 0;
+
+	// "#tad" fragments that are no json object, counted in EventNum but not stored
+	uint32 DroppedNum = 0;
+
+	// every event is handed over, waiting for the disk before the slot goes
+	bool Syncing = false;
+};
+
+// outcome of an upload, handed from the http callback to the worker
+struct FTAUploadResult
+{
+	FString Msg;
+
+	int32 Code = 0;
+
+	bool IsSuccess = false;
+
+	uint32 EventNum = 0;
+
+	uint64 BatchSeq = 0;
+
+	// when the response arrived, the worker may see it later
+	double FinishTime = 0;
+
+	// seconds asked for by a Retry-After header, 0 if none
+	double RetryAfter = 0;
+
+	// a debug request, BatchSeq is its debug queue seq
+	bool IsDebug = false;
+};
+
+// one event waiting for or in debug delivery
+struct FTADebugEvent
+{
+	FString Json;
+
+	uint64 Seq = 0;
+
+	// DEBUG_ONLY events are not stored, the receiver only validates them
+	bool DryRun = false;
+
+	bool Sending = false;
+
+	bool Done = false;
+
+	// the cache limits dropped the stored event, it is done and does not leave the store again
+	bool Dropped = false;
+
+	// client errors so far, it is dropped after FTaskHandle::MAX_REJECTED_NUM of them
+	uint32 RejectedNum = 0;
+};
+
+// work of one instance, run in slices by the shared FTAScheduler
+class FTaskHandle
 {
 public:
 
+	// runs on FTAScheduler::Get() and stores into FTAStorageEngine::Get()
 	FTaskHandle(UTDAnalyticsPC* Instance);
 
-	virtual bool Init() override;
+	// other schedulers and engines are for the automation tests
+	FTaskHandle(UTDAnalyticsPC* Instance, FTAScheduler* Scheduler, FTAStorageEngine* Engine);
 
-	virtual uint32 Run() override;
+	// one slice of queued work, true if more is left
+	bool DoWork();
 
-	virtual void Stop() override;
+	void AddTask(FString EventJsonStr);
 
-	virtual void Exit() override;
+	// stops taking events, persists the queued ones and starts one last upload
+	void Shutdown();
 
-	void AddTask(FString EventJsonStr);
+	bool IsUploading();
+
+	void RequestCallback(FString Msg, int32 Code, bool IsSuccess, uint32 EventNum, uint64 BatchSeq, double RetryAfter = 0, bool IsDebug = false);
 
-	void RequestCallback(FString Msg, int32 Code, bool IsSuccess, uint32 EventNum);
+	// hands a finished request context back to the pool
+	void ReleaseRequest(FRequestHelper* Helper);
+
+	// batch priority for TACacheEvictionPolicy::TRACK_EVENTS_FIRST, batches holding user property events are kept longer
+	const static uint8 PRIORITY_TRACK = 0;
+
+	const static uint8 PRIORITY_USER = 1;
+
+	// ADAPTIVE compresses bodies below this size at the fastest level
+	const static int32 SMALL_BATCH_BYTES = 4 * 1024;
 
 private:
 
 	UTDAnalyticsPC* m_Instance;
 
-	TArray<FString> TaskArray;
+	FTAScheduler* m_Scheduler;
+
+	// event json, or an empty string for a flush
+	TQueue<FString, EQueueMode::Mpsc> TaskQueue;
 
+	// worker side state: persisting, sealing and the legacy import. the task queue and the store synchronize themselves
 	FCriticalSection SetCritical;
 
-	UTASaveEvent* m_SaveEvent;
-	
+	// upload state only, never held across serialization, compression or disk I/O
+	FCriticalSection m_UploadCritical;
+
+	// finished uploads waiting for the worker to acknowledge them
+	TQueue<FTAUploadResult, EQueueMode::Mpsc> m_Completions;
+
+	FTAEventStore* m_Store;
+
+	// legacy UTASaveEvent slot, imported into m_Store once
 	FString m_SaveName;
 
-	bool Working;
+	TSharedPtr<FTALegacyImport> m_LegacyImport;
+
+	// outcome of the sync that ends the import, set on the I/O thread
+	FThreadSafeCounter m_LegacySyncState;
+
+	const static int32 LEGACY_SYNC_PENDING = 0;
+
+	const static int32 LEGACY_SYNC_DONE = 1;
+
+	const static int32 LEGACY_SYNC_FAILED = 2;
+
+	// events per import step, so new events and uploads keep going during a large import
+	const static uint32 LEGACY_IMPORT_CHUNK = 500;
+
+	// tasks per slice, so other instances on the same worker get their turn
+	const static uint32 TASK_SLICE = 32;
+
+	// group commit: events are written to the store every m_PersistGroupSize events or m_PersistInterval seconds
+	uint32 m_PersistGroupSize;
+
+	double m_PersistInterval;
+
+	uint32 m_UnsavedNum;
+
+	double m_LastSaveTime;
+
+	// adaptive batch size: events per batch follow m_TargetBatchBytes / m_BytesPerEvent within the event bounds,
+	// the byte target grows on fast uploads and shrinks on slow or failed ones
+	uint32 m_BatchEventNum;
+
+	uint32 m_MinBatchEvents;
+
+	uint32 m_MaxBatchEvents;
+
+	double m_TargetBatchBytes;
+
+	double m_MinBatchBytes;
+
+	double m_MaxBatchBytes;
+
+	// compressed bytes per event, moving average of the sealed batches
+	double m_BytesPerEvent;
+
+	// debug delivery, oldest first. the stored events of DEBUG mode are the head of the store in order and leave it
+	// once they and every event before them are delivered
+	TArray<FTADebugEvent> m_DebugQueue;
+
+	uint32 m_DebugStoredNum;
+
+	uint64 m_NextDebugSeq;
+
+	// stored events read ahead into m_DebugQueue
+	const static int32 DEBUG_READ_AHEAD = 64;
 
-	bool IsPaused;
+	// DEBUG_ONLY events beyond this are dropped, oldest first
+	const static int32 DEBUG_QUEUE_LIMIT = 10000;
+
+	// batch body: m_BatchHeader, the stored events spliced in as is, m_BatchFooter, the flush time and "}
+	TArray<uint8> m_BatchHeader;
+
+	TArray<uint8> m_BatchFooter;
+
+	// reused for every batch
+	TArray<uint8> m_BatchBody;
+
+	// condensed json writes the type of a user property event as "#type":"user...
+	TArray<uint8> m_UserTypeTag;
+
+	// compression totals, logged every COMPRESS_STATS_BATCHES batches
+	uint32 m_CompressNum;
+
+	int64 m_CompressRawBytes;
+
+	int64 m_CompressedBytes;
+
+	uint64 m_CompressCycles;
+
+	const static uint32 COMPRESS_STATS_BATCHES = 100;
+
+	// send time of each batch in flight
+	TMap<uint64, double> m_SendTimes;
+
+	constexpr static double FAST_UPLOAD_SECONDS = 1.0;
+
+	constexpr static double SLOW_UPLOAD_SECONDS = 3.0;
+
+	double m_LastFlushTime;
+
+	double m_LastEventTime;
+
+	// retry backoff: consecutive failures and the time before which nothing is sent. while m_RetryNum > 0 the
+	// receiver counts as degraded, one batch is in flight at a time and the age trigger is stretched
+	uint32 m_RetryNum;
+
+	double m_RetryAt;
+
+	// 2^MAX_BACKOFF_SHIFT base delays at most, before RetryMaxSeconds
+	constexpr static uint32 MAX_BACKOFF_SHIFT = 16;
+
+	// client errors of each batch in flight, it is dropped after MAX_REJECTED_NUM of them. debug events count theirs in FTADebugEvent
+	TMap<uint64, uint32> m_RejectedNums;
+
+	constexpr static uint32 MAX_REJECTED_NUM = 3;
+
+	enum class EUploadEncoding : uint8
+	{
+		// gzip is sent until the receiver accepts or rejects it
+		Probing,
+		Gzip,
+		Base64
+	};
+
+	EUploadEncoding m_Encoding;
+
+	// batches in flight as raw gzip
+	TSet<uint64> m_GzipSeqs;
+
+	// requests in flight and the batches they carry, guarded by m_UploadCritical
+	int32 m_InFlightNum;
+
+	TArray<uint64> m_InFlightSeqs;
+
+	int32 m_MaxInFlight;
+
+	int32 m_MaxDebugInFlight;
+
+	// request contexts for both windows, they live as long as the handle
+	FTARequestPool m_RequestPool;
+
+	// a completion asked for the next batch, the worker sends it
+	FThreadSafeBool m_FlushRequested;
+
+	FThreadSafeBool m_Closed;
+
+	// takes a request slot, false if the window is full
+	bool AcquireUpload(int32 Window);
+
+	void ReleaseUpload(uint64 BatchSeq);
+
+	void ProcessCompletions();
+
+	void CompleteUpload(const FTAUploadResult& Result);
 
 	void Flush();
 
+	// count, size, age and idle triggers of UTDAnalyticsSettings
+	bool ShouldFlush(double Now);
+
 	void SaveToLocal(TSharedPtr<FJsonObject> EventJson);
 
-	void FlushFromLocalNormal();
+	void PersistToLocal(bool Force);
+
+	void StartLegacyImport();
+
+	void OnLegacySlotLoaded(const FString& SlotName, const int32 UserIndex, USaveGame* SaveGame);
+
+	void ImportLegacyChunk();
+
+	// deletes the slot once the imported events are on disk, keeps it otherwise
+	void FinishLegacyImport(bool Synced);
+
+	// re-serializes a json object condensed, false if it does not parse
+	static bool CondenseJson(const FString& Json, FString& OutJson);
+
+	void SealLocalEvents();
+
+	static void AppendUtf8(TArray<uint8>& Buffer, const FString& Str);
+
+	int32 GetCompressionLevel(int32 RawSize, bool Draining);
+
+	void OnBatchSealed(uint32 EventNum, int32 RawSize, int32 CompressedSize, uint64 Cycles);
+
+	void OnBatchUploaded(bool IsSuccess, double Latency);
+
+	void ScheduleRetry(const FTAUploadResult& Result);
+
+	// a 4xx other than 408 and 429, the same body will not be taken later either
+	static bool IsRejected(int32 Code);
+
+	// counts a rejection of the batch, true once it was dropped
+	bool DropRejectedBatch(const FTAUploadResult& Result);
+
+	// settles the encoding on the answer to a gzip batch, true if the batch has to go again as base64
+	bool NegotiateEncoding(const FTAUploadResult& Result);
+
+	// a 200 whose message says the body could not be decoded
+	static bool IsUndecodableResponse(const FString& Msg);
+
+	bool FlushFromLocalNormal();
+
+	void EnqueueDryRun(const FString& EventJson);
+
+	// sends queued debug events while the debug window has room
+	void PumpDebug();
+
+	// false if no request context is free
+	bool SendDebugEvent(const FTADebugEvent& Event);
+
+	void CompleteDebug(const FTAUploadResult& Result);
+
+	// marks the stored events the cache limits dropped from the head of the store
+	void SkipDroppedEvents();
 
-	void FlushFromLocalDebug(TSharedPtr<FJsonObject> DebugJson);
+	// the delivered head leaves the queue, and its stored events the store
+	void RemoveDeliveredDebugEvents();
 };
\ No newline at end of file
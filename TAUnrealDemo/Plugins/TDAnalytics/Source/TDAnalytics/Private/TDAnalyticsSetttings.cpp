@@ -3,6 +3,6 @@
 #include "TDAnalyticsSettings.h"
 
 UTDAnalyticsSettings::UTDAnalyticsSettings(const FObjectInitializer& ObjectInitializer)
-    : Super(ObjectInitializer), ServerUrl(""), AppID(""), Mode(TAMode::NORMAL), bEnableLog(false), TimeZone("")
+    : Super(ObjectInitializer), ServerUrl(""), AppID(""), Mode(TAMode::NORMAL), bEnableLog(false), TimeZone(""), PersistGroupSize(20), PersistIntervalMs(1000), MaxCacheSizeMB(50), MaxCacheDays(10), CacheEvictionPolicy(TACacheEvictionPolicy::OLDEST_FIRST), ConfigSaveDelayMs(500), ExecutionMode(TAExecutionMode::WORKER_THREADS), WorkerThreadNum(1), WorkerThreadPriority(TAThreadPriority::BELOW_NORMAL), WorkerAffinityMask(0), FlushEventCount(20), FlushSizeKB(0), FlushMaxAgeSeconds(15.0f), FlushIdleSeconds(0), UploadEncoding(TAUploadEncoding::AUTO), CompressionLevel(TACompressionLevel::ADAPTIVE), RetryBaseSeconds(2.0f), RetryMaxSeconds(300.0f), MinBatchEvents(10), MaxBatchEvents(500), MinBatchKB(4), MaxBatchKB(256), MaxInFlightBatches(2), MaxDebugInFlight(4), ShutdownTimeoutMs(2000)
 {
 }
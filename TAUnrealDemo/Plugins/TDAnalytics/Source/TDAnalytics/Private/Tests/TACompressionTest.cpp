@@ -0,0 +1,272 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "../Common/TAConstants.h"
+#include "../Common/TAUtils.h"
+#include "../PC/TAScheduler.h"
+#include "../PC/TaskHandle.h"
+#include "../PC/TAEventStore.h"
+#include "TDAnalyticsSettings.h"
+
+#include "HAL/FileManager.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/Paths.h"
+
+static const TCHAR* COMPRESS_TEST_APP_ID = TEXT("compression_test_app");
+static const int32 COMPRESS_TEST_EVENTS = 500;
+static const int32 COMPRESS_TEST_ROUNDS = 20;
+
+// the events are built the way UTAEventManager does: preset, super and event properties merged into properties
+static FString MakeTrackEvent(const FString& DistinctID, int32 Index)
+{
+	TSharedPtr<FJsonObject> Properties = MakeShareable(new FJsonObject);
+	Properties->SetStringField(FTAConstants::KEY_LIB, TEXT("Unreal"));
+	Properties->SetStringField(FTAConstants::KEY_LIB_VERSION, TEXT("1.4.0"));
+	Properties->SetNumberField(FTAConstants::KEY_SCREEN_WIDTH, FTAUtils::GetScreenWidth());
+	Properties->SetNumberField(FTAConstants::KEY_SCREEN_HEIGHT, FTAUtils::GetScreenHeight());
+	Properties->SetStringField(FTAConstants::KEY_OS, FTAUtils::GetOS());
+	Properties->SetStringField(FTAConstants::KEY_OS_VERSION, FTAUtils::GetOSVersion());
+	Properties->SetStringField(FTAConstants::KEY_APP_VERSION, FTAUtils::GetProjectVersion());
+	Properties->SetStringField(FTAConstants::KEY_DEVICE_ID, DistinctID);
+	Properties->SetNumberField(FTAConstants::KEY_ZONE_OFFSET, 8);
+	Properties->SetStringField(FTAConstants::KEY_SYSTEM_LANGUAGE, FTAUtils::GetSystemLanguage());
+	Properties->SetStringField(FTAConstants::KEY_RAM, FTAUtils::GetMemoryStats());
+	Properties->SetStringField(FTAConstants::KEY_DISK, FTAUtils::GetDiskStats());
+	Properties->SetStringField(FTAConstants::KEY_FPS, FTAUtils::GetAverageFps());
+	Properties->SetStringField(TEXT("channel"), Index % 2 == 0 ? TEXT("steam") : TEXT("epic"));
+	Properties->SetNumberField(TEXT("server_id"), 1000 + Index % 3);
+
+	FString EventName;
+	switch ( Index % 3 )
+	{
+	case 0:
+	{
+		EventName = TEXT("level_complete");
+		Properties->SetNumberField(TEXT("level"), Index % 80);
+		Properties->SetNumberField(TEXT("duration"), 12.5 + Index * 0.731);
+		Properties->SetBoolField(TEXT("win"), Index % 4 != 0);
+		TArray<TSharedPtr<FJsonValue>> Items;
+		Items.Add(MakeShareable(new FJsonValueString(TEXT("sword"))));
+		Items.Add(MakeShareable(new FJsonValueString(FString::Printf(TEXT("potion_%d"), Index % 6))));
+		Properties->SetArrayField(TEXT("items"), Items);
+		break;
+	}
+	case 1:
+	{
+		EventName = TEXT("purchase");
+		Properties->SetStringField(TEXT("order_id"), FTAUtils::GetGuid());
+		Properties->SetNumberField(TEXT("price"), 0.99 + Index % 20);
+		Properties->SetStringField(TEXT("currency"), TEXT("USD"));
+		Properties->SetStringField(TEXT("paid_at"), FTAUtils::FormatTimeWithOffset(FDateTime::Now() - FTimespan::FromMinutes(Index), 8));
+		break;
+	}
+	default:
+	{
+		EventName = TEXT("session_stats");
+		TSharedPtr<FJsonObject> Stats = MakeShareable(new FJsonObject);
+		Stats->SetNumberField(TEXT("kills"), Index % 17);
+		Stats->SetNumberField(TEXT("deaths"), Index % 5);
+		Stats->SetStringField(TEXT("map"), FString::Printf(TEXT("arena_%02d"), Index % 12));
+		Properties->SetObjectField(TEXT("stats"), Stats);
+		break;
+	}
+	}
+
+	TSharedPtr<FJsonObject> Data = MakeShareable(new FJsonObject);
+	Data->SetStringField(FTAConstants::KEY_TYPE, FTAConstants::EVENTTYPE_TRACK);
+	Data->SetStringField(FTAConstants::KEY_EVENT_NAME, EventName);
+	Data->SetStringField(FTAConstants::KEY_TIME, FTAUtils::FormatTimeWithOffset(FDateTime::Now(), 8));
+	Data->SetStringField(FTAConstants::KEY_DISTINCT_ID, DistinctID);
+	Data->SetStringField(FTAConstants::KEY_DATA_ID, FTAUtils::GetGuid());
+	Data->SetObjectField(FTAConstants::KEY_PROPERTIES, Properties);
+
+	FString DataStr;
+	TSharedRef<TJsonWriter<>> DataWriter = TJsonWriterFactory<>::Create(&DataStr);
+	FJsonSerializer::Serialize(Data.ToSharedRef(), DataWriter);
+	return DataStr;
+}
+
+// the shape of UTAEventManager::EnqueueUserEvent
+static FString MakeUserEvent(const FString& DistinctID, int32 Index)
+{
+	TSharedPtr<FJsonObject> Properties = MakeShareable(new FJsonObject);
+	bool IsSet = Index % 2 == 0;
+	if ( IsSet )
+	{
+		Properties->SetStringField(TEXT("nickname"), FString::Printf(TEXT("player_%d"), Index));
+		Properties->SetNumberField(TEXT("level"), Index % 80);
+	}
+	else
+	{
+		Properties->SetNumberField(TEXT("coins"), Index * 7 % 500);
+	}
+
+	TSharedPtr<FJsonObject> Data = MakeShareable(new FJsonObject);
+	Data->SetStringField(FTAConstants::KEY_TYPE, IsSet ? FTAConstants::EVENTTYPE_USER_SET : FTAConstants::EVENTTYPE_USER_ADD);
+	Data->SetStringField(FTAConstants::KEY_TIME, FTAUtils::FormatTimeWithOffset(FDateTime::Now(), 8));
+	Data->SetStringField(FTAConstants::KEY_DISTINCT_ID, DistinctID);
+	Data->SetStringField(FTAConstants::KEY_DATA_ID, FTAUtils::GetGuid());
+	Data->SetObjectField(FTAConstants::KEY_PROPERTIES, Properties);
+
+	FString DataStr;
+	TSharedRef<TJsonWriter<>> DataWriter = TJsonWriterFactory<>::Create(&DataStr);
+	FJsonSerializer::Serialize(Data.ToSharedRef(), DataWriter);
+	return DataStr;
+}
+
+// runs COMPRESS_TEST_EVENTS events through a task handle and returns what SaveToLocal stored, condensed as batches splice it
+static bool StoreTestEvents(TArray<FString>& OutEvents)
+{
+	FString Directory = FPaths::AutomationTransientDir() / TEXT("TDAnalyticsCompression");
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+	// nothing is sealed, every event stays readable in the log
+	UTDAnalyticsSettings* Settings = GetMutableDefault<UTDAnalyticsSettings>();
+	int32 MinBatchEvents = Settings->MinBatchEvents;
+	int32 MaxBatchEvents = Settings->MaxBatchEvents;
+	Settings->MinBatchEvents = COMPRESS_TEST_EVENTS + 1;
+	Settings->MaxBatchEvents = COMPRESS_TEST_EVENTS + 1;
+
+	FTAStorageEngine* Engine = new FTAStorageEngine(Directory, false);
+	FTAScheduler* Scheduler = new FTAScheduler(false);
+	// NORMAL mode without a track state: events are stored, nothing is uploaded
+	UTDAnalyticsPC* Instance = NewObject<UTDAnalyticsPC>();
+	Instance->InstanceAppID = COMPRESS_TEST_APP_ID;
+	FTaskHandle* Handle = new FTaskHandle(Instance, Scheduler, Engine);
+	Scheduler->Register(Handle);
+	Settings->MinBatchEvents = MinBatchEvents;
+	Settings->MaxBatchEvents = MaxBatchEvents;
+
+	FString DistinctID = FTAUtils::GetGuid();
+	for (int32 i = 0; i < COMPRESS_TEST_EVENTS; i++)
+	{
+		Handle->AddTask(i % 5 == 4 ? MakeUserEvent(DistinctID, i) : MakeTrackEvent(DistinctID, i));
+	}
+
+	FTAEventStore* Store = Engine->OpenPartition(COMPRESS_TEST_APP_ID);
+	double Deadline = FPlatformTime::Seconds() + 30.0;
+	while ( Store->PendingNum() < (uint32)COMPRESS_TEST_EVENTS && FPlatformTime::Seconds() < Deadline )
+	{
+		FPlatformProcess::Sleep(0.001f);
+	}
+	Store->GetEventJsons(0, COMPRESS_TEST_EVENTS, OutEvents);
+
+	Scheduler->Shutdown(0);
+	Engine->Shutdown();
+	delete Scheduler;
+	delete Handle;
+	delete Engine;
+	Instance->RemoveFromRoot();
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+	return OutEvents.Num() == COMPRESS_TEST_EVENTS;
+}
+
+// the body SealLocalEvents builds from EventNum stored events
+static void BuildTestBatch(const TArray<FString>& Events, int32 EventNum, TArray<uint8>& OutBody)
+{
+	FString Body = FString::Printf(TEXT("{\"%s\":["), ANSI_TO_TCHAR(FTAConstants::KEY_DATA));
+	for (int32 i = 0; i < EventNum; i++)
+	{
+		if ( i > 0 )
+		{
+			Body += TEXT(",");
+		}
+		Body += Events[i];
+	}
+	Body += FString::Printf(TEXT("],\"%s\":\"%s\",\"%s\":\"%s\"}"), ANSI_TO_TCHAR(FTAConstants::KEY_APP_ID), COMPRESS_TEST_APP_ID,
+		ANSI_TO_TCHAR(FTAConstants::KEY_FLUSH_TIME), *FTAUtils::GetCurrentTimeStamp());
+	OutBody.Reset();
+	FTCHARToUTF8 Converter(*Body, Body.Len());
+	OutBody.Append((const uint8*)Converter.Get(), Converter.Length());
+}
+
+struct FTACompressionResult
+{
+	int32 Size = 0;
+
+	double Seconds = 0;
+};
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTACompressionLevelTest, "TDAnalytics.Compression.LevelComparison", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FTACompressionLevelTest::RunTest(const FString& Parameters)
+{
+	TArray<FString> Events;
+	if ( !TestTrue(TEXT("every event is stored"), StoreTestEvents(Events)) )
+	{
+		return false;
+	}
+
+	// the largest body ADAPTIVE sends at the fastest level, the first batch of a session and a drain batch
+	int32 SmallNum = 0;
+	TArray<uint8> Body;
+	while ( SmallNum < Events.Num() )
+	{
+		BuildTestBatch(Events, SmallNum + 1, Body);
+		if ( Body.Num() >= FTaskHandle::SMALL_BATCH_BYTES )
+		{
+			break;
+		}
+		SmallNum++;
+	}
+	TestTrue(TEXT("a small batch holds events"), SmallNum > 0);
+	const TCHAR* BodyNames[] = { TEXT("small"), TEXT("regular"), TEXT("drain") };
+	const int32 BodyEventNums[] = { SmallNum, 50, COMPRESS_TEST_EVENTS };
+
+	const int32 Levels[] = { FTAUtils::GZIP_LEVEL_FASTEST, FTAUtils::GZIP_LEVEL_DEFAULT, FTAUtils::GZIP_LEVEL_SMALLEST };
+	FTACompressionResult Results[3][3];
+	int32 RawSizes[3] = { 0, 0, 0 };
+	for (int32 b = 0; b < 3; b++)
+	{
+		BuildTestBatch(Events, BodyEventNums[b], Body);
+		RawSizes[b] = Body.Num();
+		for (int32 i = 0; i < 3; i++)
+		{
+			TArray<uint8> Compressed;
+			double StartTime = FPlatformTime::Seconds();
+			for (int32 Round = 0; Round < COMPRESS_TEST_ROUNDS; Round++)
+			{
+				TestTrue(TEXT("gzip succeeds"), FTAUtils::CompressData(Body.GetData(), Body.Num(), Compressed, Levels[i]));
+			}
+			Results[b][i].Seconds = (FPlatformTime::Seconds() - StartTime) / COMPRESS_TEST_ROUNDS;
+			Results[b][i].Size = Compressed.Num();
+
+			TArray<uint8> Uncompressed;
+			Uncompressed.SetNumUninitialized(Body.Num());
+			TestTrue(TEXT("output is valid gzip"), FCompression::UncompressMemory(NAME_Gzip, Uncompressed.GetData(), Uncompressed.Num(), Compressed.GetData(), Compressed.Num()));
+			TestTrue(TEXT("output restores the body"), Uncompressed == Body);
+
+			AddInfo(FString::Printf(TEXT("%s batch of %d events, level %d: %d -> %d bytes, ratio %.2f, %.3f ms"), BodyNames[b], BodyEventNums[b], Levels[i],
+				Body.Num(), Results[b][i].Size, (double)Body.Num() / FMath::Max(Results[b][i].Size, 1), Results[b][i].Seconds * 1000.0));
+		}
+	}
+
+	for (int32 b = 0; b < 3; b++)
+	{
+		double FastestRatio = (double)RawSizes[b] / FMath::Max(Results[b][0].Size, 1);
+		// json with uuids, times and numbers in every event, not the repeated text a synthetic body is
+		TestTrue(FString::Printf(TEXT("%s batch: the fastest level compresses at least 2.5 times"), BodyNames[b]), FastestRatio >= 2.5);
+		TestTrue(FString::Printf(TEXT("%s batch: higher levels are not larger"), BodyNames[b]),
+			Results[b][2].Size <= Results[b][1].Size && Results[b][1].Size <= Results[b][0].Size);
+		for (int32 i = 0; i < 3; i++)
+		{
+			// the worker compresses inline, a drain batch must not hold it up for long
+			TestTrue(FString::Printf(TEXT("%s batch: level %d compresses at least 10 MB/s"), BodyNames[b], Levels[i]),
+				RawSizes[b] >= Results[b][i].Seconds * 10 * 1024 * 1024);
+		}
+	}
+
+	// SMALL_BATCH_BYTES: below it a higher level saves less than the http headers of the request cost
+	TestTrue(TEXT("small batch: the default level saves under 512 bytes"), Results[0][0].Size - Results[0][1].Size < 512);
+	// regular batches: the default level is the cheap win over the fastest one
+	TestTrue(TEXT("regular batch: the default level is smaller than the fastest"), Results[1][1].Size < Results[1][0].Size);
+	// drain batches: the smallest level still pays off where bytes on the wire matter more than the worker's time
+	TestTrue(TEXT("drain batch: the smallest level is smaller than the default"), Results[2][2].Size < Results[2][1].Size);
+	TestTrue(TEXT("drain batch: the smallest level costs at most 5 times the default"), Results[2][2].Seconds <= Results[2][1].Seconds * 5.0);
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,58 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "../PC/TAEventRecord.h"
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTAEventRecordCodecTest, "TDAnalytics.EventRecord.Codec", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FTAEventRecordCodecTest::RunTest(const FString& Parameters)
+{
+	// round trip, UTF-8 payloads included
+	const FString First = TEXT("{\"#event_name\":\"login\"}");
+	const FString Second = TEXT("{\"name\":\"\u4E2D\u6587\"}");
+	TArray<uint8> Buffer;
+	FTAEventRecord::Append(Buffer, First);
+	FTAEventRecord::Append(Buffer, Second);
+
+	FTAEventRecordView Record;
+	TestTrue(TEXT("first record decodes"), FTAEventRecord::Decode(Buffer.GetData(), Buffer.Num(), Record) == ETARecordStatus::Valid);
+	TestEqual(TEXT("first payload"), Record.ToString(), First);
+	TestEqual(TEXT("record type"), Record.Type, (uint8)ETARecordType::EventJson);
+	int32 Offset = Record.RecordSize;
+	TestTrue(TEXT("second record decodes"), FTAEventRecord::Decode(Buffer.GetData() + Offset, Buffer.Num() - Offset, Record) == ETARecordStatus::Valid);
+	TestEqual(TEXT("second payload"), Record.ToString(), Second);
+	TestEqual(TEXT("records fill the buffer"), Offset + Record.RecordSize, Buffer.Num());
+
+	// a torn tail is truncated, not corrupted
+	TestTrue(TEXT("short header"), FTAEventRecord::Decode(Buffer.GetData(), FTAEventRecord::HEADER_SIZE - 1, Record) == ETARecordStatus::Truncated);
+	TestTrue(TEXT("short payload"), FTAEventRecord::Decode(Buffer.GetData() + Offset, Buffer.Num() - Offset - 1, Record) == ETARecordStatus::Truncated);
+
+	// a flipped payload byte fails the crc
+	TArray<uint8> Flipped = Buffer;
+	Flipped[FTAEventRecord::HEADER_SIZE] ^= 0x20;
+	TestTrue(TEXT("flipped payload"), FTAEventRecord::Decode(Flipped.GetData(), Flipped.Num(), Record) == ETARecordStatus::Corrupted);
+
+	// the crc covers the type byte
+	TArray<uint8> Retyped = Buffer;
+	Retyped[8] = (uint8)ETARecordType::GzipBatch;
+	TestTrue(TEXT("changed type"), FTAEventRecord::Decode(Retyped.GetData(), Retyped.Num(), Record) == ETARecordStatus::Corrupted);
+
+	// a garbage size is rejected before it is trusted
+	TArray<uint8> Oversized = Buffer;
+	FTAEventRecord::WriteUInt32(Oversized.GetData(), (uint32)FTAEventRecord::MAX_PAYLOAD_SIZE + 1);
+	TestTrue(TEXT("oversized payload"), FTAEventRecord::Decode(Oversized.GetData(), Oversized.Num(), Record) == ETARecordStatus::Corrupted);
+
+	// binary payloads keep their type
+	const uint8 Binary[] = { 0, 1, 2, 255 };
+	TArray<uint8> BinaryBuffer;
+	FTAEventRecord::Append(BinaryBuffer, Binary, sizeof(Binary), (uint8)ETARecordType::GzipBatch);
+	TestTrue(TEXT("binary record decodes"), FTAEventRecord::Decode(BinaryBuffer.GetData(), BinaryBuffer.Num(), Record) == ETARecordStatus::Valid);
+	TestEqual(TEXT("binary type"), Record.Type, (uint8)ETARecordType::GzipBatch);
+	TestTrue(TEXT("binary payload"), Record.PayloadSize == sizeof(Binary) && FMemory::Memcmp(Record.Payload, Binary, sizeof(Binary)) == 0);
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,221 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "../PC/TAEventStore.h"
+
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+static const TCHAR* TEST_APP_ID = TEXT("store_test_app");
+
+static FString GetStoreTestDir()
+{
+	return FPaths::AutomationTransientDir() / TEXT("TDAnalyticsStore");
+}
+
+static void SealTestBatch(FTAEventStore* Store)
+{
+	TArray<uint8> Body;
+	Body.Add(1);
+	Store->AddEvent(TEXT("{\"#event_name\":\"test\"}"));
+	Store->Commit();
+	Store->SealBatch(Body, 1, 0);
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTAEventStoreSeqAfterCompactionTest, "TDAnalytics.EventStore.SeqAfterCompaction", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FTAEventStoreSeqAfterCompactionTest::RunTest(const FString& Parameters)
+{
+	FString Directory = GetStoreTestDir();
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+	// drain and compact, nothing but the cursor is left on disk
+	FTAStorageEngine* Engine = new FTAStorageEngine(Directory);
+	FTAEventStore* Store = Engine->OpenPartition(TEST_APP_ID);
+	SealTestBatch(Store);
+	TArray<uint8> Body;
+	uint32 EventNum = 0;
+	uint64 Seq = 0;
+	TestTrue(TEXT("sealed batch is peeked"), Store->PeekBatch(Body, EventNum, Seq, TArray<uint64>()));
+	Store->RemoveBatch(Seq);
+	Store->Compact();
+	Engine->Shutdown();
+	delete Engine;
+
+	// seal offline after a restart
+	Engine = new FTAStorageEngine(Directory);
+	Store = Engine->OpenPartition(TEST_APP_ID);
+	TestEqual(TEXT("nothing left after compaction"), Store->BatchNum(), 0u);
+	SealTestBatch(Store);
+	Engine->Shutdown();
+	delete Engine;
+
+	// the batch survives the next restart
+	Engine = new FTAStorageEngine(Directory);
+	Store = Engine->OpenPartition(TEST_APP_ID);
+	TestEqual(TEXT("offline batch recovered"), Store->BatchNum(), 1u);
+	TestEqual(TEXT("offline events recovered"), Store->Num(), 1u);
+	Engine->Shutdown();
+	delete Engine;
+
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTAEventStoreRecoveryTest, "TDAnalytics.EventStore.Recovery", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FTAEventStoreRecoveryTest::RunTest(const FString& Parameters)
+{
+	FString Directory = GetStoreTestDir();
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+	// three events reach the log, the first one is consumed
+	FTAStorageEngine* Engine = new FTAStorageEngine(Directory);
+	FTAEventStore* Store = Engine->OpenPartition(TEST_APP_ID);
+	for (int32 i = 0; i < 3; i++)
+	{
+		Store->AddEvent(FString::Printf(TEXT("{\"index\":%d}"), i));
+	}
+	Store->Commit();
+	Store->RemoveEvents(1);
+	Engine->Shutdown();
+	delete Engine;
+
+	// a crash tore the next commit group
+	TArray<FString> LogNames;
+	IFileManager::Get().FindFiles(LogNames, *(Directory / TEXT("*.tdlog")), true, false);
+	TestEqual(TEXT("one live log"), LogNames.Num(), 1);
+	if ( LogNames.Num() == 1 )
+	{
+		TArray<uint8> Torn;
+		FTAEventRecord::Append(Torn, TEXT("{\"index\":3}"));
+		Torn.SetNum(Torn.Num() / 2);
+		FFileHelper::SaveArrayToFile(Torn, *(Directory / LogNames[0]), &IFileManager::Get(), FILEWRITE_Append);
+	}
+
+	// the consumed event stays consumed, the torn one is dropped
+	Engine = new FTAStorageEngine(Directory);
+	Store = Engine->OpenPartition(TEST_APP_ID);
+	TestEqual(TEXT("pending events recovered"), Store->PendingNum(), 2u);
+	TArray<FString> Events;
+	Store->GetEventJsons(0, 10, Events);
+	TestEqual(TEXT("recovered event count"), Events.Num(), 2);
+	if ( Events.Num() == 2 )
+	{
+		TestEqual(TEXT("oldest pending event"), Events[0], FString(TEXT("{\"index\":1}")));
+		TestEqual(TEXT("newest intact event"), Events[1], FString(TEXT("{\"index\":2}")));
+	}
+
+	// the torn tail was cut, later commits append behind intact records
+	Store->AddEvent(TEXT("{\"index\":4}"));
+	Store->Commit();
+	Engine->Shutdown();
+	delete Engine;
+
+	Engine = new FTAStorageEngine(Directory);
+	Store = Engine->OpenPartition(TEST_APP_ID);
+	TestEqual(TEXT("events after the repair"), Store->PendingNum(), 3u);
+	Engine->Shutdown();
+	delete Engine;
+
+	// the live log is locked by another process while the SDK starts, a failed read is no torn log
+	LogNames.Empty();
+	IFileManager::Get().FindFiles(LogNames, *(Directory / TEXT("*.tdlog")), true, false);
+	TestEqual(TEXT("one live log before the lock"), LogNames.Num(), 1);
+	FString LockedPath = LogNames.Num() > 0 ? Directory / LogNames[0] : FString();
+	IFileHandle* Lock = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*LockedPath, true, false);
+	TestNotNull(TEXT("log is locked"), Lock);
+
+	Engine = new FTAStorageEngine(Directory);
+	Store = Engine->OpenPartition(TEST_APP_ID);
+	TestTrue(TEXT("unreadable log is kept"), IFileManager::Get().FileExists(*LockedPath));
+	Store->AddEvent(TEXT("{\"index\":5}"));
+	Store->Commit();
+	Engine->Shutdown();
+	delete Engine;
+	TestTrue(TEXT("unreadable log survives the run"), IFileManager::Get().FileExists(*LockedPath));
+	TArray<FString> HoldNames;
+	IFileManager::Get().FindFiles(HoldNames, *(Directory / TEXT("*.tdhold")), true, false);
+	bool Held = HoldNames.Num() > 0;
+	if ( !Held )
+	{
+		AddInfo(TEXT("the platform does not lock files against reads, the log was read as usual"));
+	}
+	delete Lock;
+
+	// readable again: nothing pending was lost, the events of the locked run included
+	Engine = new FTAStorageEngine(Directory);
+	Store = Engine->OpenPartition(TEST_APP_ID);
+	TestEqual(TEXT("events after the lock"), Store->PendingNum(), 4u);
+	Engine->Shutdown();
+	delete Engine;
+	if ( Held )
+	{
+		TestFalse(TEXT("imported log is deleted"), IFileManager::Get().FileExists(*LockedPath));
+	}
+
+	Engine = new FTAStorageEngine(Directory);
+	Store = Engine->OpenPartition(TEST_APP_ID);
+	TestEqual(TEXT("imported events are not doubled"), Store->PendingNum(), 4u);
+	Engine->Shutdown();
+	delete Engine;
+
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTAEventStorePendingLimitsTest, "TDAnalytics.EventStore.PendingLimits", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FTAEventStorePendingLimitsTest::RunTest(const FString& Parameters)
+{
+	FString Directory = GetStoreTestDir();
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+	// nothing is sealed, like DEBUG with an unreachable receiver
+	FTAStorageEngine* Engine = new FTAStorageEngine(Directory);
+	FTAEventStore* Store = Engine->OpenPartition(TEST_APP_ID);
+	for (int32 i = 0; i < 100; i++)
+	{
+		Store->AddEvent(FString::Printf(TEXT("{\"index\":%d,\"padding\":\"%s\"}"), i, *FString::ChrN(64, TEXT('x'))));
+	}
+	Store->Commit();
+	int64 Bytes = Store->Bytes();
+	Store->SetLimits(Bytes / 2, 0, false);
+	TestTrue(TEXT("pending events fit the size limit"), Store->Bytes() <= Bytes / 2);
+	uint32 DroppedNum = Store->TakeDroppedNum();
+	TestTrue(TEXT("over-size events dropped"), DroppedNum > 0);
+	TestEqual(TEXT("dropped from the pending ones"), Store->PendingNum(), 100u - DroppedNum);
+	TestEqual(TEXT("drops are reported"), Store->GetEvictedNum(), DroppedNum);
+
+	// the oldest are dropped, the head is the first one that fit
+	TArray<FString> Events;
+	Store->GetEventJsons(0, 1, Events);
+	TestTrue(TEXT("oldest left is the first kept"), Events.Num() == 1 && Events[0].StartsWith(FString::Printf(TEXT("{\"index\":%d,"), DroppedNum)));
+
+	// age: every pending event expires once it is older than the limit
+	Store->SetLimits(0, 1, false);
+	FPlatformProcess::Sleep(2.1f);
+	Store->Compact();
+	TestEqual(TEXT("expired events dropped"), Store->PendingNum(), 0u);
+	TestEqual(TEXT("expired drops are reported"), Store->TakeDroppedNum(), 100u - DroppedNum);
+	Engine->Shutdown();
+	delete Engine;
+
+	// the drops moved the cursor, they do not come back
+	Engine = new FTAStorageEngine(Directory);
+	Store = Engine->OpenPartition(TEST_APP_ID);
+	TestEqual(TEXT("dropped events stay dropped"), Store->PendingNum(), 0u);
+	Engine->Shutdown();
+	delete Engine;
+
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
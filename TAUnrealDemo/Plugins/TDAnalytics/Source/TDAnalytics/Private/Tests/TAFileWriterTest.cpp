@@ -0,0 +1,75 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "../PC/TAFileWriter.h"
+
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+static const int32 WRITER_TASK_NUM = 2000;
+static const int32 WRITER_RECORD_SIZE = 512;
+
+// appends WRITER_TASK_NUM records with a flush each, like the group commit does. returns the seconds until the last one is on disk
+static double RunWriterBenchmark(bool UseTaskGraph, const FString& Path, bool& OutOrdered)
+{
+	IFileManager::Get().Delete(*Path, false, true, true);
+	IFileHandle* Handle = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*Path, false, false);
+	if ( !Handle )
+	{
+		OutOrdered = false;
+		return 0;
+	}
+
+	TArray<int32> Order;
+	double StartTime = FPlatformTime::Seconds();
+	FTAFileWriter* Writer = new FTAFileWriter(TEXT("TDAnalyticsTestIO"), UseTaskGraph);
+	for (int32 i = 0; i < WRITER_TASK_NUM; i++)
+	{
+		Writer->Enqueue([Handle, &Order, i]()
+		{
+			TArray<uint8> Record;
+			Record.Init((uint8)i, WRITER_RECORD_SIZE);
+			Handle->Write(Record.GetData(), Record.Num());
+			Handle->Flush();
+			Order.Add(i);
+		});
+	}
+	Writer->Flush();
+	double Seconds = FPlatformTime::Seconds() - StartTime;
+	delete Writer;
+	delete Handle;
+
+	OutOrdered = Order.Num() == WRITER_TASK_NUM;
+	for (int32 i = 0; i < Order.Num() && OutOrdered; i++)
+	{
+		OutOrdered = Order[i] == i;
+	}
+	OutOrdered = OutOrdered && IFileManager::Get().FileSize(*Path) == (int64)WRITER_TASK_NUM * WRITER_RECORD_SIZE;
+	IFileManager::Get().Delete(*Path, false, true, true);
+	return Seconds;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTAFileWriterModeTest, "TDAnalytics.FileWriter.ModeComparison", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FTAFileWriterModeTest::RunTest(const FString& Parameters)
+{
+	FString Path = FPaths::AutomationTransientDir() / TEXT("TDAnalyticsWriter.bin");
+
+	bool ThreadOrdered = false;
+	double ThreadSeconds = RunWriterBenchmark(false, Path, ThreadOrdered);
+	TestTrue(TEXT("io thread keeps the queue order"), ThreadOrdered);
+
+	bool TaskGraphOrdered = false;
+	double TaskGraphSeconds = RunWriterBenchmark(true, Path, TaskGraphOrdered);
+	TestTrue(TEXT("task graph keeps the queue order"), TaskGraphOrdered);
+
+	AddInfo(FString::Printf(TEXT("%d flushed writes: io thread %.1f ms, task graph %.1f ms"), WRITER_TASK_NUM, ThreadSeconds * 1000.0, TaskGraphSeconds * 1000.0));
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
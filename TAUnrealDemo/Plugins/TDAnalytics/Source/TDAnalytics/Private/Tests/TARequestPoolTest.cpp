@@ -0,0 +1,119 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "../PC/TARequestPool.h"
+
+#include "Math/RandomStream.h"
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTARequestPoolTest, "TDAnalytics.RequestPool.Reuse", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FTARequestPoolTest::RunTest(const FString& Parameters)
+{
+	// every context exists up front
+	FTARequestPool Pool(2);
+	TestEqual(TEXT("two contexts created"), Pool.Num(), 2);
+	TestEqual(TEXT("all free"), Pool.FreeNum(), 2);
+
+	FRequestHelper* First = Pool.Acquire();
+	FRequestHelper* Second = Pool.Acquire();
+	TestNotNull(TEXT("first context"), First);
+	TestTrue(TEXT("contexts in flight differ"), First != Second);
+	TestEqual(TEXT("none free"), Pool.FreeNum(), 0);
+
+	// a full pool refuses instead of growing
+	TestNull(TEXT("no third context"), Pool.Acquire());
+	TestEqual(TEXT("pool did not grow"), Pool.Num(), 2);
+
+	// a released context is handed out again
+	TestTrue(TEXT("release succeeds"), Pool.Release(First));
+	TestEqual(TEXT("one free"), Pool.FreeNum(), 1);
+	TestTrue(TEXT("released context is reused"), Pool.Acquire() == First);
+
+	// a double release would hand one context to two requests
+	TestTrue(TEXT("release succeeds"), Pool.Release(Second));
+	TestFalse(TEXT("double release is refused"), Pool.Release(Second));
+	TestEqual(TEXT("released once"), Pool.FreeNum(), 1);
+
+	FTARequestPool OtherPool(1);
+	TestFalse(TEXT("foreign context is refused"), OtherPool.Release(First));
+	TestEqual(TEXT("other pool keeps its own"), OtherPool.FreeNum(), 1);
+	return true;
+}
+
+static const int32 SOAK_MAX_IN_FLIGHT = 2;
+static const int32 SOAK_MAX_DEBUG_IN_FLIGHT = 4;
+static const int32 SOAK_CYCLES = 20000;
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTARequestPoolSoakTest, "TDAnalytics.RequestPool.Soak", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FTARequestPoolSoakTest::RunTest(const FString& Parameters)
+{
+	// sized like FTaskHandle's pool, requests follow its windows: batches and debug events share one in-flight count,
+	// each kind is sent only while the count is below its own window
+	const int32 Capacity = SOAK_MAX_IN_FLIGHT + SOAK_MAX_DEBUG_IN_FLIGHT;
+	FTARequestPool Pool(Capacity);
+	FRandomStream Random(20220601);
+	TArray<FRequestHelper*> InFlight;
+	int32 RetryNum = 0;
+	int32 SentNum = 0;
+	int32 FailedNum = 0;
+	int32 DebugNum = 0;
+	int32 RefusedNum = 0;
+	int32 MaxNum = Pool.Num();
+
+	for (int32 Cycle = 0; Cycle < SOAK_CYCLES; Cycle++)
+	{
+		// send: fill a window, a failed request from the last completion goes first
+		bool IsDebug = Random.FRand() < 0.3f;
+		int32 Window = IsDebug ? SOAK_MAX_DEBUG_IN_FLIGHT : SOAK_MAX_IN_FLIGHT;
+		while ( InFlight.Num() < Window && (RetryNum > 0 || Random.FRand() < 0.7f) )
+		{
+			FRequestHelper* Helper = Pool.Acquire();
+			if ( !Helper )
+			{
+				RefusedNum++;
+				break;
+			}
+			InFlight.Add(Helper);
+			RetryNum = FMath::Max(RetryNum - 1, 0);
+			SentNum++;
+			DebugNum += IsDebug ? 1 : 0;
+		}
+
+		// complete in any order: the context goes back first, then a failure is queued for a retry
+		int32 CompleteNum = InFlight.Num() > 0 ? Random.RandRange(0, InFlight.Num()) : 0;
+		for (int32 i = 0; i < CompleteNum; i++)
+		{
+			int32 Index = Random.RandRange(0, InFlight.Num() - 1);
+			TestTrue(TEXT("completed context is released"), Pool.Release(InFlight[Index]));
+			InFlight.RemoveAtSwap(Index);
+			if ( Random.FRand() < 0.2f )
+			{
+				RetryNum++;
+				FailedNum++;
+			}
+		}
+
+		MaxNum = FMath::Max(MaxNum, Pool.Num());
+		if ( Pool.Num() != Capacity || Pool.FreeNum() + InFlight.Num() != Capacity )
+		{
+			AddError(FString::Printf(TEXT("cycle %d: %d contexts, %d free, %d in flight"), Cycle, Pool.Num(), Pool.FreeNum(), InFlight.Num()));
+			break;
+		}
+	}
+
+	for (FRequestHelper* Helper : InFlight)
+	{
+		Pool.Release(Helper);
+	}
+	TestEqual(TEXT("no context ever refused within the windows"), RefusedNum, 0);
+	TestEqual(TEXT("pool never grows past the cap"), MaxNum, Capacity);
+	TestEqual(TEXT("every context is free at the end"), Pool.FreeNum(), Capacity);
+	AddInfo(FString::Printf(TEXT("%d requests, %d failed, %d debug, %d contexts"), SentNum, FailedNum, DebugNum, MaxNum));
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,131 @@
+// Copyright 2022 ThinkingData. All Rights Reserved.
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "../PC/TAScheduler.h"
+#include "../PC/TaskHandle.h"
+#include "../PC/TAEventStore.h"
+
+#include "Containers/Ticker.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/Paths.h"
+
+static const int32 SCHEDULER_APP_NUM = 4;
+static const int32 SCHEDULER_EVENT_NUM = 2000;
+static const double SCHEDULER_TIMEOUT_SECONDS = 60.0;
+
+static FString MakeSchedulerTestEvent(int32 AppIndex, int32 Index)
+{
+	// the shape UTAEventManager hands over: preset, super and event properties of mixed types
+	return FString::Printf(TEXT("{\"#type\":\"track\",\"#event_name\":\"level_%d\",\"#time\":\"2022-06-01 12:%02d:%02d.%03d\",")
+		TEXT("\"#distinct_id\":\"device_%d\",\"#uuid\":\"%s\",\"properties\":{\"#lib\":\"Unreal\",\"#lib_version\":\"1.4.0\",")
+		TEXT("\"#os\":\"Windows\",\"#screen_width\":1920,\"#screen_height\":1080,\"#zone_offset\":8,\"channel\":\"store_%d\",")
+		TEXT("\"level\":%d,\"score\":%.2f,\"win\":%s,\"items\":[\"sword\",\"potion_%d\"],\"extra\":{\"combo\":%d}}}"),
+		Index % 50, (Index / 60) % 60, Index % 60, Index % 1000, AppIndex, *FGuid::NewGuid().ToString(EGuidFormats::DigitsWithHyphens),
+		Index % 7, Index % 50, Index * 1.37, Index % 3 == 0 ? TEXT("true") : TEXT("false"), Index % 5, Index % 11);
+}
+
+// feeds SCHEDULER_EVENT_NUM events to each of SCHEDULER_APP_NUM handles on a scheduler of that mode. returns the seconds
+// until every event is stored and on disk, the game loop is stood in for by pumping the core ticker
+static double RunSchedulerBenchmark(FAutomationTestBase& Test, bool UseTaskGraph)
+{
+	FString Directory = FPaths::AutomationTransientDir() / TEXT("TDAnalyticsScheduler");
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+	FTAStorageEngine* Engine = new FTAStorageEngine(Directory, UseTaskGraph);
+	FTAScheduler* Scheduler = new FTAScheduler(UseTaskGraph);
+	TArray<UTDAnalyticsPC*> Instances;
+	TArray<FTaskHandle*> Handles;
+	TArray<FTAEventStore*> Stores;
+	for (int32 i = 0; i < SCHEDULER_APP_NUM; i++)
+	{
+		// NORMAL mode without a track state: events are stored and sealed, nothing is uploaded
+		UTDAnalyticsPC* Instance = NewObject<UTDAnalyticsPC>();
+		Instance->InstanceAppID = FString::Printf(TEXT("scheduler_test_app_%d"), i);
+		FTaskHandle* Handle = new FTaskHandle(Instance, Scheduler, Engine);
+		Scheduler->Register(Handle);
+		Instances.Add(Instance);
+		Handles.Add(Handle);
+		Stores.Add(Engine->OpenPartition(Instance->InstanceAppID));
+	}
+
+	TArray<FString> Events;
+	for (int32 i = 0; i < SCHEDULER_EVENT_NUM; i++)
+	{
+		Events.Add(MakeSchedulerTestEvent(i % SCHEDULER_APP_NUM, i));
+	}
+
+	double StartTime = FPlatformTime::Seconds();
+	for (int32 i = 0; i < SCHEDULER_EVENT_NUM; i++)
+	{
+		for (FTaskHandle* Handle : Handles)
+		{
+			Handle->AddTask(Events[i]);
+		}
+	}
+
+	bool Stored = false;
+	while ( !Stored && FPlatformTime::Seconds() - StartTime < SCHEDULER_TIMEOUT_SECONDS )
+	{
+#if ENGINE_MAJOR_VERSION >= 5
+		FTSTicker::GetCoreTicker().Tick(0.001f);
+#else
+		FTicker::GetCoreTicker().Tick(0.001f);
+#endif // ENGINE_MAJOR_VERSION >= 5
+		Stored = true;
+		for (FTAEventStore* Store : Stores)
+		{
+			Stored &= Store->Num() >= (uint32)SCHEDULER_EVENT_NUM;
+		}
+		if ( !Stored )
+		{
+			FPlatformProcess::Sleep(0.001f);
+		}
+	}
+	bool Synced = Stores[0]->Commit() && Stores[0]->Sync();
+	double Seconds = FPlatformTime::Seconds() - StartTime;
+
+	const TCHAR* ModeName = UseTaskGraph ? TEXT("task graph") : TEXT("worker threads");
+	Test.TestTrue(FString::Printf(TEXT("%s store every event"), ModeName), Stored);
+	Test.TestTrue(FString::Printf(TEXT("%s write every event"), ModeName), Synced);
+	Test.TestEqual(FString::Printf(TEXT("%s keep their mode"), ModeName), Scheduler->IsUsingTaskGraph(), UseTaskGraph);
+	for (FTAEventStore* Store : Stores)
+	{
+		Test.TestEqual(FString::Printf(TEXT("%s store no event twice"), ModeName), Store->Num(), (uint32)SCHEDULER_EVENT_NUM);
+		Test.TestTrue(FString::Printf(TEXT("%s seal batches"), ModeName), Store->BatchNum() > 0);
+	}
+
+	Scheduler->Shutdown(0);
+	Engine->Shutdown();
+	delete Scheduler;
+	for (FTaskHandle* Handle : Handles)
+	{
+		delete Handle;
+	}
+	delete Engine;
+	for (UTDAnalyticsPC* Instance : Instances)
+	{
+		Instance->RemoveFromRoot();
+	}
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+	return Seconds;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTASchedulerModeTest, "TDAnalytics.Scheduler.ModeComparison", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FTASchedulerModeTest::RunTest(const FString& Parameters)
+{
+	double ThreadSeconds = RunSchedulerBenchmark(*this, false);
+	double TaskGraphSeconds = RunSchedulerBenchmark(*this, true);
+
+	int32 EventNum = SCHEDULER_APP_NUM * SCHEDULER_EVENT_NUM;
+	AddInfo(FString::Printf(TEXT("%d events on %d handles: worker threads %.1f ms (%.0f events/s), task graph %.1f ms (%.0f events/s)"),
+		EventNum, SCHEDULER_APP_NUM, ThreadSeconds * 1000.0, EventNum / FMath::Max(ThreadSeconds, 0.001),
+		TaskGraphSeconds * 1000.0, EventNum / FMath::Max(TaskGraphSeconds, 0.001)));
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -10,6 +10,10 @@
 #include "TDAnalyticsProvider.h"
 #include "TDAnalyticsSettings.h"
 
+#if PLATFORM_MAC || PLATFORM_WINDOWS
+#include "./PC/TDAnalyticsPC.h"
+#endif
+
 #define LOCTEXT_NAMESPACE "FTDAnalyticsModule"
 DEFINE_LOG_CATEGORY_STATIC(LogTDAnalytics, Display, All);
 IMPLEMENT_MODULE(FAnalyticsTDAnalytics, TDAnalytics)
@@ -35,6 +39,10 @@ void FAnalyticsTDAnalytics::ShutdownModule()
 {
     // This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
     // we call this function before unloading the module.
+#if PLATFORM_MAC || PLATFORM_WINDOWS
+    // no-op when OnPreExit already ran it
+    UTDAnalyticsPC::Shutdown();
+#endif
     
     // Free the dll handle
 }
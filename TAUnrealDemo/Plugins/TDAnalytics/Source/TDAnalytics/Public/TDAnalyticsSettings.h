@@ -12,6 +12,46 @@ enum class TAMode : uint8
     DEBUG_ONLY = 2
 };
 
+UENUM()
+enum class TACacheEvictionPolicy : uint8
+{
+    OLDEST_FIRST = 0,
+    TRACK_EVENTS_FIRST = 1
+};
+
+UENUM()
+enum class TAExecutionMode : uint8
+{
+    WORKER_THREADS = 0,
+    TASK_GRAPH = 1
+};
+
+UENUM()
+enum class TAUploadEncoding : uint8
+{
+    AUTO = 0,
+    GZIP = 1,
+    BASE64 = 2
+};
+
+UENUM()
+enum class TACompressionLevel : uint8
+{
+    ADAPTIVE = 0,
+    FASTEST = 1,
+    DEFAULT = 2,
+    SMALLEST = 3
+};
+
+UENUM()
+enum class TAThreadPriority : uint8
+{
+    LOWEST = 0,
+    BELOW_NORMAL = 1,
+    NORMAL = 2,
+    ABOVE_NORMAL = 3
+};
+
 UCLASS(config = Engine, defaultconfig)
 class UTDAnalyticsSettings : public UObject
 {
@@ -58,5 +98,105 @@ public:
     // runs SDK in the given timezone
     UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "TimeZone"))
     FString TimeZone;
+
+    // PC: number of cached events written to disk together in one save
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Persist Group Size", ClampMin = "1"))
+    int32 PersistGroupSize;
+
+    // PC: longest time (ms) a cached event may wait in memory before it is written, i.e. the crash-loss window
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Persist Interval (ms)", ClampMin = "0"))
+    int32 PersistIntervalMs;
+
+    // PC: max disk space (MB) of the local event cache, 0 means unlimited
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Max Cache Size (MB)", ClampMin = "0"))
+    int32 MaxCacheSizeMB;
+
+    // PC: cached events older than this many days are dropped, 0 means never
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Max Cache Days", ClampMin = "0"))
+    int32 MaxCacheDays;
+
+    // PC: which cached batches are dropped first when the cache is over its size
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Cache Eviction Policy"))
+    TACacheEvictionPolicy CacheEvictionPolicy;
+
+    // PC: identity and super property changes within this window (ms) are saved together in one background write
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Config Save Delay (ms)", ClampMin = "0"))
+    int32 ConfigSaveDelayMs;
+
+    // PC: run background work on the SDK's own worker threads, or as engine task graph jobs without extra threads
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Execution Mode"))
+    TAExecutionMode ExecutionMode;
+
+    // PC: number of background worker threads shared by all instances
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Worker Threads", ClampMin = "1"))
+    int32 WorkerThreadNum;
+
+    // PC: priority of the background worker threads
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Worker Thread Priority"))
+    TAThreadPriority WorkerThreadPriority;
+
+    // PC: cores the background worker threads may run on, 0 means the engine's pool thread mask
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Worker Affinity Mask"))
+    int64 WorkerAffinityMask;
+
+    // PC: upload once this many events are cached, 0 disables the trigger. flush triggers are read live and may be changed at runtime
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Flush Event Count", ClampMin = "0"))
+    int32 FlushEventCount;
+
+    // PC: upload once the cached events take this many KB, 0 disables the trigger
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Flush Size (KB)", ClampMin = "0"))
+    int32 FlushSizeKB;
+
+    // PC: upload cached events at least every this many seconds, 0 disables the trigger
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Flush Max Age (s)", ClampMin = "0"))
+    float FlushMaxAgeSeconds;
+
+    // PC: upload once no event was tracked for this many seconds, 0 disables the trigger
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Flush Idle Time (s)", ClampMin = "0"))
+    float FlushIdleSeconds;
+
+    // PC: send batches as raw gzip with Content-Encoding, as base64 text, or try gzip first and fall back to base64 if the receiver rejects it
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Upload Encoding"))
+    TAUploadEncoding UploadEncoding;
+
+    // PC: gzip effort of upload batches. ADAPTIVE uses the fastest level for small batches and the smallest output while a backlog drains
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Compression Level"))
+    TACompressionLevel CompressionLevel;
+
+    // PC: first delay (s) before a failed upload is retried, doubled on each further failure
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Retry Base Delay (s)", ClampMin = "0.1"))
+    float RetryBaseSeconds;
+
+    // PC: longest delay (s) between retries, a Retry-After from the receiver may ask for more
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Retry Max Delay (s)", ClampMin = "1"))
+    float RetryMaxSeconds;
+
+    // PC: fewest events per upload batch
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Min Batch Events", ClampMin = "1"))
+    int32 MinBatchEvents;
+
+    // PC: most events per upload batch
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Max Batch Events", ClampMin = "1"))
+    int32 MaxBatchEvents;
+
+    // PC: smallest compressed body (KB) batches aim for, the target shrinks towards it on slow or failed uploads
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Min Batch Size (KB)", ClampMin = "1"))
+    int32 MinBatchKB;
+
+    // PC: largest compressed body (KB) batches aim for, the target grows towards it while uploads are fast
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Max Batch Size (KB)", ClampMin = "1"))
+    int32 MaxBatchKB;
+
+    // PC: number of upload batches that may be in flight at once per instance, acknowledged in any order
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Max In-Flight Batches", ClampMin = "1"))
+    int32 MaxInFlightBatches;
+
+    // PC: number of debug requests that may be in flight at once per instance in DEBUG and DEBUG_ONLY mode
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Max In-Flight Debug Requests", ClampMin = "1"))
+    int32 MaxDebugInFlight;
+
+    // PC: on exit, longest time (ms) to wait for the final upload of cached events
+    UPROPERTY(Config, EditAnywhere, Category = "TDAnalytics", meta = (DisplayName = "Shutdown Timeout (ms)", ClampMin = "0"))
+    int32 ShutdownTimeoutMs;
 };
 
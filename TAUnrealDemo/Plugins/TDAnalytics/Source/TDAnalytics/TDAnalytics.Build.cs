@@ -61,6 +61,9 @@ namespace UnrealBuildTool.Rules
                 "EngineSettings"
             }
             );
+            // gzip with an explicit deflate level, FCompression ignores its flags for gzip
+            AddEngineThirdPartyPrivateStaticDependencies(Target, "zlib");
+
             if (Target.Type == TargetRules.TargetType.Editor)
             {
                 PrivateDependencyModuleNames.Add("UnrealEd");